@@ -0,0 +1,111 @@
+#ifndef __OPTIONS_H_
+#define __OPTIONS_H_
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "def.h"
+
+
+// Параметры командной строки исполняемых файлов: --ключ значение или флаг --ключ.
+// Системы (--syst) - имена из systNamesT или номера 0..4 через запятую
+class Options
+{
+public:
+    Options( int argc, char **argv, const std::string &usage ):
+        fUsage(usage)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg.compare(0, 2, "--") != 0)
+            {
+                fBad = "unexpected argument " + arg;
+                continue;
+            }
+            std::string key = arg.substr(2), value;
+            if (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0) value = argv[++i];
+            fValues[key] = value;
+        }
+    }
+
+    // false - неизвестный ключ или ошибка разбора (печатается вместе с подсказкой)
+    bool Check( const std::vector<std::string> &known ) const
+    {
+        std::string bad = fBad;
+        if (fValues.count("help")) bad = "usage";
+        for (const auto &kv: fValues)
+        {
+            bool found = false;
+            for (const std::string &key: known)
+                if (kv.first == key) found = true;
+            if (!found && kv.first != "help") bad = "unknown option --" + kv.first;
+        }
+        if (bad.empty()) return true;
+        std::cerr << bad << std::endl << "Usage: " << fUsage << std::endl;
+        return false;
+    }
+
+    bool Has( const std::string &key ) const { return fValues.count(key) > 0; }
+
+    std::string Get( const std::string &key, const std::string &def ) const
+    {
+        auto it = fValues.find(key);
+        return (it != fValues.end() && !it->second.empty()) ? it->second : def;
+    }
+
+    int GetInt( const std::string &key, int def ) const
+    {
+        auto it = fValues.find(key);
+        return (it != fValues.end() && !it->second.empty()) ? atoi(it->second.c_str()) : def;
+    }
+
+    double GetDouble( const std::string &key, double def ) const
+    {
+        auto it = fValues.find(key);
+        return (it != fValues.end() && !it->second.empty()) ? atof(it->second.c_str()) : def;
+    }
+
+    std::vector<std::string> GetList( const std::string &key ) const
+    {
+        std::vector<std::string> list;
+        std::istringstream ss(Get(key, ""));
+        std::string item;
+        while (std::getline(ss, item, ','))
+            if (!item.empty()) list.push_back(item);
+        return list;
+    }
+
+    // Номера систем; пусто - ошибка (неизвестное имя) или ключ не задан, тогда def
+    std::vector<int> Systems( const std::string &key, const std::vector<int> &def ) const
+    {
+        if (!Has(key)) return def;
+        std::vector<int> systs;
+        for (const std::string &name: GetList(key))
+        {
+            int syst = -1;
+            for (int i = 0; i < 5; i++)
+                if (name == systNamesT[i].Data() || name == std::to_string(i)) syst = i;
+            if (syst < 0)
+            {
+                std::cerr << "unknown system " << name << std::endl;
+                return std::vector<int>();
+            }
+            systs.push_back(syst);
+        }
+        return systs;
+    }
+
+    void Usage() const { std::cerr << "Usage: " << fUsage << std::endl; }
+
+private:
+    std::string fUsage, fBad;
+    std::map<std::string, std::string> fValues;
+};
+
+
+#endif /* __OPTIONS_H_ */
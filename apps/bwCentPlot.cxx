@@ -0,0 +1,22 @@
+// Параметры по центральностям одной системы (CentDrawParams.C) без интерпретатора
+#include "CentDrawParams.C"
+#include "Options.h"
+
+
+int main( int argc, char **argv )
+{
+    Options opt(argc, argv, "bwCentPlot --syst <AuAu|pAl|HeAu|CuAu|UU|0..4>");
+    if (!opt.Check({"syst"})) return 1;
+
+    vector<int> systs = opt.Systems("syst", {systN});
+    if (systs.size() != 1)
+    {
+        opt.Usage();
+        return 1;
+    }
+
+    gROOT->SetBatch(kTRUE);
+    systN = systs[0];
+    CentDrawParams();
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Финальный фит без интерпретатора:
+//   --mode all     - BlastWaveFinal_all.C для одной системы (фит, параметры, контуры, рисунки)
+//   --mode systems - BlastWaveFinal_systems.C, несколько систем параллельно
+//   --mode sweep   - BlastWaveSweep.C, системы для каждого файла настроек из --settings
+#include "BlastWaveFinal_all.C"
+#include "BlastWaveFinal_systems.C"
+#include "BlastWaveSweep.C"
+#include "Options.h"
+
+
+int main( int argc, char **argv )
+{
+    Options opt(argc, argv, "bwFinal [--mode all|systems|sweep] --syst <AuAu|pAl|HeAu|CuAu|UU|0..4>[,...]\n"
+                            "        [--threads n] [--settings file[,...]] [--covariance] [--sys-correlation x] [--cache]");
+    if (!opt.Check({"mode", "syst", "threads", "settings", "covariance", "sys-correlation", "cache"})) return 1;
+
+    string mode = opt.Get("mode", "all");
+    vector<int> systs = opt.Systems("syst", (mode == "all") ? vector<int>{systN} : vector<int>{0, 1, 2, 3, 4});
+    if (systs.empty()) return 1;
+
+    gROOT->SetBatch(kTRUE);
+    if (mode == "all")
+    {
+        // BlastWaveFinal_all работает с глобальными массивами def.h и systN, поэтому одна система на запуск
+        if (systs.size() != 1)
+        {
+            cerr << "bwFinal: --mode all takes one system" << endl;
+            return 1;
+        }
+        systN = systs[0];
+        BlastWaveFinal_all();
+    }
+    else if (mode == "systems")
+        BlastWaveFinal_systems(systs, opt.GetInt("threads", 0), opt.Has("covariance"), opt.GetDouble("sys-correlation", 1.),
+                               opt.Has("cache"));
+    else if (mode == "sweep")
+    {
+        vector<string> settingsFiles = opt.GetList("settings");
+        if (settingsFiles.empty())
+        {
+            opt.Usage();
+            return 1;
+        }
+        BlastWaveSweep(settingsFiles, systs, opt.GetInt("threads", 0));
+    }
+    else
+    {
+        opt.Usage();
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+// Глобальный фит (BlastWaveGlobal_all.C) без интерпретатора
+#include "BlastWaveGlobal_all.C"
+#include "Options.h"
+
+
+int main( int argc, char **argv )
+{
+    Options opt(argc, argv, "bwGlobal --syst <AuAu|pAl|HeAu|CuAu|UU|0..4>[,...] [--charge all|pos|neg] [--quad 0|16|32|64]\n"
+                            "         [--profile] [--npart-degree n] [--starts n] [--settings file]\n"
+                            "         [--least-squares] [--covariance] [--sys-correlation x]");
+    if (!opt.Check({"syst", "charge", "quad", "profile", "npart-degree", "starts", "settings",
+                    "least-squares", "covariance", "sys-correlation"})) return 1;
+
+    vector<int> systs = opt.Systems("syst", {systN});
+    if (systs.empty()) return 1;
+
+    gROOT->SetBatch(kTRUE);
+    for (int syst: systs)
+    {
+        systN = syst;
+        BlastWaveGlobal_all(opt.Get("charge", "all"), (EQuadrature)opt.GetInt("quad", kGauss32), opt.Has("profile"),
+                            opt.GetInt("npart-degree", -1), opt.GetInt("starts", 0),
+                            opt.Get("settings", "input/config/fitSettings.txt"), opt.Has("least-squares"),
+                            opt.Has("covariance"), opt.GetDouble("sys-correlation", 1.));
+    }
+    return 0;
+}
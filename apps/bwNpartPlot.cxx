@@ -0,0 +1,14 @@
+// Параметры всех систем по Npart (NpartDrawParams.cc) без интерпретатора
+#include "NpartDrawParams.cc"
+#include "Options.h"
+
+
+int main( int argc, char **argv )
+{
+    Options opt(argc, argv, "bwNpartPlot");
+    if (!opt.Check({})) return 1;
+
+    gROOT->SetBatch(kTRUE);
+    NpartDrawParams();
+    return 0;
+}
@@ -0,0 +1,17 @@
+// Систематика параметров (BlastWaveSystematics.C) без интерпретатора
+#include "BlastWaveSystematics.C"
+#include "Options.h"
+
+
+int main( int argc, char **argv )
+{
+    Options opt(argc, argv, "bwSystematics [--syst <AuAu|pAl|HeAu|CuAu|UU|0..4>[,...]] [--threads n] [--no-tables] [--no-cache]");
+    if (!opt.Check({"syst", "threads", "no-tables", "no-cache"})) return 1;
+
+    vector<int> systs = opt.Systems("syst", {0, 1, 2, 3, 4});
+    if (systs.empty()) return 1;
+
+    gROOT->SetBatch(kTRUE);
+    BlastWaveSystematics(systs, !opt.Has("no-tables"), opt.GetInt("threads", 0), !opt.Has("no-cache"));
+    return 0;
+}
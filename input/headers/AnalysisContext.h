@@ -0,0 +1,129 @@
+#ifndef __ANALYSISCONTEXT_H_
+#define __ANALYSISCONTEXT_H_
+
+#include <functional>
+#include <memory>
+#include "TROOT.h"
+#include "Math/MinimizerOptions.h"
+
+#include "def.h"
+#include "WriteReadFiles.h"
+#include "TaskScheduler.h"
+#include "WarmStart.h"
+
+
+// Состояние анализа одной системы столкновений: спектры, функции фита, диапазоны,
+// стартовые значения и результаты. Поля - указатели на массивы той же формы, что и в def.h:
+// либо на собственное хранилище контекста (AnalysisContext(systN)),
+// либо на глобальные массивы (AnalysisContext::Global() - для существующих макросов).
+// Несколько контекстов с собственным хранилищем можно фитировать одновременно (Run).
+struct AnalysisContext
+{
+    int systN;
+
+    TGraphErrors *(*grSpectra)[N_CENTR];
+    double (*spectraSys)[N_CENTR][MAX_POINTS];  // систематические ошибки точек grSpectra
+    TF1 *(*ifuncx)[N_CENTR];
+    TF1 *(*ifuncxGlobal)[N_CENTR];
+    TGraph *(*contour)[N_CENTR][N_SIGMA];
+    double (*paramsGlobal)[N_CENTR][8];
+
+    double *xmin, *xmax;                    // диапазоны фита по частицам
+    double *handT, *handBeta;               // стартовые значения по центральностям
+    double (*handConst)[MAX_CENTR];
+
+    double (*constPar)[N_CENTR];
+    double (*Tpar)[N_CENTR], (*Tpar_err)[N_CENTR], (*Tpar_sys)[N_CENTR];
+    double (*utPar)[N_CENTR], (*utPar_err)[N_CENTR], (*utPar_sys)[N_CENTR];
+
+    WarmStart warmStart;                    // сошедшиеся параметры как старт следующих фитов
+
+    // Собственное хранилище; стартовые значения и диапазоны копируются из def.h
+    explicit AnalysisContext( int systN_ ):
+        systN(systN_), fStorage(new Storage())
+    {
+        Storage &s = *fStorage;
+        std::copy(::xmin, ::xmin + MAX_PARTS, s.xmin);
+        std::copy(::xmax, ::xmax + MAX_PARTS, s.xmax);
+        std::copy(::handT, ::handT + N_CENTR, s.handT);
+        std::copy(::handBeta, ::handBeta + N_CENTR, s.handBeta);
+        std::copy(&::handConst[0][0], &::handConst[0][0] + MAX_PARTS * MAX_CENTR, &s.handConst[0][0]);
+
+        Bind(s.grSpectra, s.spectraSys, s.ifuncx, s.ifuncxGlobal, s.contour, s.paramsGlobal, s.xmin, s.xmax,
+             s.handT, s.handBeta, s.handConst, s.constPar, s.Tpar, s.Tpar_err, s.Tpar_sys,
+             s.utPar, s.utPar_err, s.utPar_sys);
+    }
+
+    // Контекст поверх глобальных массивов def.h; systN берётся из глобального systN
+    static AnalysisContext &Global()
+    {
+        static AnalysisContext global;
+        global.systN = ::systN;
+        return global;
+    }
+
+    TString Name() const { return systNamesT[systN]; }
+    int NCentr() const { return N_CENTR_SYST[systN]; }
+    int Centr( int j ) const { return CENTR_SYST[systN][j]; }
+
+    // Чтение спектров системы в grSpectra контекста
+    void ReadSpectra()
+    {
+        if (systN == 0)
+            ReadFromFileAuAu(grSpectra);
+        else
+            for (int part: PARTS) ReadFromFile(part, systN, grSpectra, spectraSys);
+    }
+
+    // Выполнить func для каждого контекста, до nThreads одновременно (0 - по числу ядер).
+    // TMinuit использует общий статический объект, поэтому при параллельном запуске - Minuit2
+    static void Run( const vector<AnalysisContext *> &contexts, const std::function<void(AnalysisContext &)> &func,
+                     int nThreads = 0 )
+    {
+        if (nThreads != 1)
+        {
+            ROOT::EnableThreadSafety();
+            if (ROOT::Math::MinimizerOptions::DefaultMinimizerType() == "Minuit")
+                ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2");
+        }
+        TaskScheduler::Run(contexts.size(), nThreads, [&](int i) { func(*contexts[i]); });
+    }
+
+private:
+    struct Storage
+    {
+        TGraphErrors *grSpectra[MAX_PARTS][N_CENTR] = {};
+        double spectraSys[MAX_PARTS][N_CENTR][MAX_POINTS] = {};
+        TF1 *ifuncx[MAX_PARTS][N_CENTR] = {}, *ifuncxGlobal[MAX_PARTS][N_CENTR] = {};
+        TGraph *contour[MAX_PARTS][N_CENTR][N_SIGMA] = {};
+        double paramsGlobal[2][N_CENTR][8] = {};
+        double xmin[MAX_PARTS], xmax[MAX_PARTS];
+        double handT[N_CENTR], handBeta[N_CENTR], handConst[MAX_PARTS][MAX_CENTR];
+        double constPar[N_PARTS][N_CENTR] = {};
+        double Tpar[N_PARTS][N_CENTR] = {}, Tpar_err[N_PARTS][N_CENTR] = {}, Tpar_sys[N_PARTS][N_CENTR] = {};
+        double utPar[N_PARTS][N_CENTR] = {}, utPar_err[N_PARTS][N_CENTR] = {}, utPar_sys[N_PARTS][N_CENTR] = {};
+    };
+    std::unique_ptr<Storage> fStorage;
+
+    AnalysisContext():
+        systN(::systN)
+    {
+        Bind(::grSpectra, ::spectraSys, ::ifuncx, ::ifuncxGlobal, ::contour, ::paramsGlobal, ::xmin, ::xmax,
+             ::handT, ::handBeta, ::handConst, ::constPar, ::Tpar, ::Tpar_err, ::Tpar_sys,
+             ::utPar, ::utPar_err, ::utPar_sys);
+    }
+
+    void Bind( TGraphErrors *gr[][N_CENTR], double sys[][N_CENTR][MAX_POINTS], TF1 *f[][N_CENTR], TF1 *fGlobal[][N_CENTR], TGraph *cont[][N_CENTR][N_SIGMA],
+               double parGlobal[][N_CENTR][8], double *xlo, double *xhi, double *T0, double *beta0, double con0[][MAX_CENTR],
+               double c[][N_CENTR], double T[][N_CENTR], double Terr[][N_CENTR], double Tsys[][N_CENTR],
+               double ut[][N_CENTR], double utErr[][N_CENTR], double utSys[][N_CENTR] )
+    {
+        grSpectra = gr; spectraSys = sys; ifuncx = f; ifuncxGlobal = fGlobal; contour = cont; paramsGlobal = parGlobal;
+        xmin = xlo; xmax = xhi; handT = T0; handBeta = beta0; handConst = con0;
+        constPar = c; Tpar = T; Tpar_err = Terr; Tpar_sys = Tsys;
+        utPar = ut; utPar_err = utErr; utPar_sys = utSys;
+    }
+};
+
+
+#endif /* __ANALYSISCONTEXT_H_ */
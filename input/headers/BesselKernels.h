@@ -0,0 +1,112 @@
+#ifndef __BESSELKERNELS_H_
+#define __BESSELKERNELS_H_
+
+#include <cmath>
+
+// Функции Бесселя для подынтегральной функции blastwave сразу для массива радиальных узлов.
+//
+// Используются те же полиномиальные приближения (Abramowitz & Stegun 9.8.1 - 9.8.8), что и в
+// TMath::BesselI0/I1/K0/K1, но в экспоненциально масштабированном виде:
+//     I0e(x) = exp(-x) I0(x),  K1e(x) = exp(x) K1(x)
+// Произведение I0(a) K1(b) = I0e(a) K1e(b) exp(a - b) не переполняется при больших a и b.
+//
+// Обе ветви приближений считаются без ветвлений и выбираются тернарным оператором,
+// поэтому циклы по узлам векторизуются компилятором: AVX-512 (8 double) или AVX2 (4 double).
+// Векторные exp и log - из libmvec (glibc): их объявления в <math.h> есть только с -ffast-math,
+// поэтому ниже они объявлены для GCC отдельно, без -ffast-math. sqrt векторизуется инструкцией,
+// но только без errno, так что нужны -O3 -march=native -fopenmp-simd -fno-math-errno
+// (в CMakeLists.txt - только для файлов с этими ядрами). Без этих флагов (и в cling)
+// те же циклы выполняются скалярно.
+
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__CLING__) && !defined(__FAST_MATH__) \
+    && defined(__x86_64__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 22))
+// exp(double) и log(double) с векторными вариантами _ZGV*_exp, _ZGV*_log из libmvec
+// (libm.so подключает её сама)
+extern "C"
+{
+    __attribute__((simd("notinbranch"))) double exp( double ) __THROW;
+    __attribute__((simd("notinbranch"))) double log( double ) __THROW;
+}
+#endif
+
+namespace BesselKernels
+{
+    // exp(-x) I0(x), x >= 0
+    inline double I0e( double x )
+    {
+        double t = x / 3.75, y = t * t, z = 3.75 / x;
+        double small = exp(-x) * (1.0 + y * (3.5156229 + y * (3.0899424 + y * (1.2067492
+                     + y * (0.2659732 + y * (3.60768e-2 + y * 4.5813e-3))))));
+        double large = (0.39894228 + z * (1.328592e-2 + z * (2.25319e-3 + z * (-1.57565e-3
+                     + z * (9.16281e-3 + z * (-2.057706e-2 + z * (2.635537e-2 + z * (-1.647633e-2
+                     + z * 3.92377e-3)))))))) / sqrt(x);
+        return (x < 3.75) ? small : large;
+    }
+
+    // exp(-x) I1(x), x >= 0
+    inline double I1e( double x )
+    {
+        double t = x / 3.75, y = t * t, z = 3.75 / x;
+        double small = exp(-x) * x * (0.5 + y * (0.87890594 + y * (0.51498869 + y * (0.15084934
+                     + y * (2.658733e-2 + y * (3.01532e-3 + y * 3.2411e-4))))));
+        double large = (0.39894228 + z * (-3.988024e-2 + z * (-3.62018e-3 + z * (1.63801e-3
+                     + z * (-1.031555e-2 + z * (2.282967e-2 + z * (-2.895312e-2 + z * (1.787654e-2
+                     + z * -4.20059e-3)))))))) / sqrt(x);
+        return (x < 3.75) ? small : large;
+    }
+
+    // exp(x) K0(x), x > 0
+    inline double K0e( double x )
+    {
+        double y = 0.25 * x * x, z = 2.0 / x;
+        double small = exp(x) * (-log(0.5 * x) * I0e(x) * exp(x) + (-0.57721566 + y * (0.42278420
+                     + y * (0.23069756 + y * (3.488590e-2 + y * (2.62698e-3 + y * (1.0750e-4 + y * 7.4e-6)))))));
+        double large = (1.25331414 + z * (-7.832358e-2 + z * (2.189568e-2 + z * (-1.062446e-2
+                     + z * (5.87872e-3 + z * (-2.51540e-3 + z * 5.3208e-4)))))) / sqrt(x);
+        return (x <= 2.0) ? small : large;
+    }
+
+    // exp(x) K1(x), x > 0
+    inline double K1e( double x )
+    {
+        double y = 0.25 * x * x, z = 2.0 / x;
+        double small = exp(x) * (log(0.5 * x) * I1e(x) * exp(x) + (1.0 / x) * (1.0 + y * (0.15443144
+                     + y * (-0.67278579 + y * (-0.18156897 + y * (-1.919402e-2 + y * (-1.10404e-3 + y * -4.686e-5)))))));
+        double large = (1.25331414 + z * (0.23498619 + z * (-3.655620e-2 + z * (1.504268e-2
+                     + z * (-7.80353e-3 + z * (3.25614e-3 + z * -6.8245e-4)))))) / sqrt(x);
+        return (x <= 2.0) ? small : large;
+    }
+
+
+    // out[k] = I0(a[k]) * K1(b[k]) для k = 0..n-1
+    inline void I0K1( const double *a, const double *b, double *out, int n )
+    {
+#pragma omp simd
+        for (int k = 0; k < n; k++)
+            out[k] = I0e(a[k]) * K1e(b[k]) * exp(a[k] - b[k]);
+    }
+
+    // Произведения, нужные для интеграла и его производных:
+    // i0k1 = I0(a) K1(b), i1k1 = I1(a) K1(b), i0k0 = I0(a) K0(b) и, если i1k0 != 0, i1k0 = I1(a) K0(b)
+    inline void Products( const double *a, const double *b, double *i0k1, double *i1k1, double *i0k0, int n,
+                          double *i1k0 = 0 )
+    {
+#pragma omp simd
+        for (int k = 0; k < n; k++)
+        {
+            double e = exp(a[k] - b[k]);
+            double i0 = I0e(a[k]), k1 = K1e(b[k]);
+            i0k1[k] = i0 * k1 * e;
+            i1k1[k] = I1e(a[k]) * k1 * e;
+            i0k0[k] = i0 * K0e(b[k]) * e;
+        }
+
+        if (!i1k0) return;
+#pragma omp simd
+        for (int k = 0; k < n; k++)
+            i1k0[k] = I1e(a[k]) * K0e(b[k]) * exp(a[k] - b[k]);
+    }
+}
+
+
+#endif /* __BESSELKERNELS_H_ */
@@ -1,7 +1,14 @@
+#ifndef __BLASTWAVE_H_
+#define __BLASTWAVE_H_
+
 #include <iostream>
 #include <fstream>
+#include <vector>
 #include "TF1.h"
 #include "TMath.h"
+#include "TGraph.h"
+#include "Math/Integrator.h"
+#include "BesselKernels.h"
 
 using namespace std;
 
@@ -31,14 +38,78 @@ double bwfitfunc(double *x, double *par)
 }
 
 
+//	узлы и веса квадратуры Гаусса-Лежандра порядка n на отрезке [a, b]
+void GaussLegendreNodes( int n, double a, double b, double *x, double *w )
+{
+	double xm = 0.5 * (b + a);
+	double xl = 0.5 * (b - a);
+
+	for (int i = 0; i < (n + 1) / 2; i++)
+	{
+		// начальное приближение для i-го корня полинома Лежандра P_n
+		double z = cos(TMath::Pi() * (i + 0.75) / (n + 0.5));
+		double z1, dp = 1;
+
+		for (int iter = 0; iter < 100; iter++)
+		{
+			double p1 = 1.0, p2 = 0.0;
+			for (int j = 1; j <= n; j++)
+			{
+				double p3 = p2;
+				p2 = p1;
+				p1 = ((2.0 * j - 1.0) * z * p2 - (j - 1.0) * p3) / j;
+			}
+			dp = n * (z * p1 - p2) / (z * z - 1.0);
+			z1 = z;
+			z = z1 - p1 / dp;
+			if (fabs(z - z1) < 1.e-15) break;
+		}
+
+		x[i] = xm - xl * z;
+		x[n - 1 - i] = xm + xl * z;
+		w[i] = 2.0 * xl / ((1.0 - z * z) * dp * dp);
+		w[n - 1 - i] = w[i];
+	}
+}
+
+
+//	фиксированная квадратура Гаусса-Лежандра с числом узлов N, известным при компиляции
+//	узлы задаются по u = r/R на [0.0001/R, 1] - те же пределы, что у адаптивного интеграла
+template <int N>
+struct GaussLegendreRule
+{
+	GaussLegendreRule( double a = 0.0001 / 13.0, double b = 1.0 )
+	{
+		GaussLegendreNodes(N, a, b, x, w);
+	}
+
+	double x[N], w[N];
+
+	//	таблица строится один раз на всю программу
+	static const GaussLegendreRule &Get()
+	{
+		static const GaussLegendreRule rule;
+		return rule;
+	}
+};
+
+
+//	способ интегрирования по r: адаптивный TF1::Integral или Гаусс-Лежандр на 16/32/64 узла
+enum EQuadrature { kAdaptive = 0, kGauss16 = 16, kGauss32 = 32, kGauss64 = 64 };
+EQuadrature gQuadrature = kAdaptive;    // по умолчанию для новых MyIntegFunc и BlastWaveBatch
+
+
 //	structure representing the integral of a function between 0 and radius
+//	хранит параметры в param[] и меняет общий fFunc, поэтому не реентерабельна;
+//	для параллельных фитов - BlastWaveModel
 struct MyIntegFunc
 {
 	//	constructor using the TF1 pointer
-	MyIntegFunc(TF1 *f):
-		fFunc(f) {}
+	MyIntegFunc(TF1 *f, EQuadrature quad = gQuadrature):
+		fFunc(f), fQuad(quad) {}
 
 	TF1 *fFunc; // pointer to the integral function
+	EQuadrature fQuad; // quadrature backend
    	double param[5]; 
 
 	//	evaluate the integral of fFunc (pt, r) in r
@@ -51,6 +122,320 @@ struct MyIntegFunc
 		param[4] = *x;    // set value of pt for integrand function (fFunc)
 		// cout << param[0] << " " << param[1] << " " << param[2] << " " << param[3] << " " << endl;
 		fFunc->SetParameters(param);
-		return fFunc->Integral(0.0001, radius, 1.e-10);
+
+		switch (fQuad)
+		{
+			case kGauss16: return GaussIntegral(GaussLegendreRule<16>::Get(), radius);
+			case kGauss32: return GaussIntegral(GaussLegendreRule<32>::Get(), radius);
+			case kGauss64: return GaussIntegral(GaussLegendreRule<64>::Get(), radius);
+			default:       return fFunc->Integral(0.0001, radius, 1.e-10);
+		}
 	}
-};
\ No newline at end of file
+
+	//	фиксированное число вызовов подынтегральной функции: N на каждую точку pt
+	template <int N>
+	double GaussIntegral( const GaussLegendreRule<N> &rule, double radius )
+	{
+		double sum = 0;
+		for (int k = 0; k < N; k++)
+		{
+			double r = rule.x[k] * radius;
+			sum += rule.w[k] * fFunc->EvalPar(&r, param);
+		}
+		return sum * radius;
+	}
+};
+
+//	пакетный расчёт интеграла blastwave сразу для всех точек спектра
+//	радиальные узлы и SinH(rho), CosH(rho) зависят только от (T, beta), 
+//	поэтому считаются один раз на весь спектр, а не для каждой точки pt
+struct BlastWaveBatch
+{
+	//	по умолчанию интегрируем по тем же пределам, что и MyIntegFunc,
+	//	число узлов берётся из gQuadrature (для kAdaptive - 32)
+	BlastWaveBatch( int nNodes = (gQuadrature == kAdaptive) ? 32 : gQuadrature, double rMin = 0.0001, double rMax = 13.0 ):
+		fN(nNodes), fRadius(rMax), fR(nNodes), fW(nNodes)
+	{
+		GaussLegendreNodes(fN, rMin, rMax, fR.data(), fW.data());
+		for (int k = 0; k < fN; k++) fW[k] *= fR[k];   // множитель r из подынтегральной функции
+	}
+
+	int fN;                 // число радиальных узлов
+	double fRadius;         // Rmax = 13 fm
+	std::vector<double> fR; // узлы по r
+	std::vector<double> fW; // веса, умноженные на r
+
+	//	наибольшее число узлов для Value на стеке (GaussLegendreRule до 64)
+	static const int kMaxNodes = 64;
+
+	//	SinH(rho)/T и CosH(rho)/T во всех узлах: одна expm1 на узел вместо SinH и CosH
+	//	(expm1, а не exp: у малых rho около центра нет потери точности в e - 1/e)
+	void Nodes( double T, double beta, double *sh, double *ch ) const
+	{
+		double rhoMax = TMath::ATanH(beta);
+		for (int k = 0; k < fN; k++)
+		{
+			double em1 = expm1(rhoMax * fR[k] / fRadius), e = em1 + 1.;
+			sh[k] = 0.5 * (em1 + em1 / e) / T;
+			ch[k] = 0.5 * (e + 1. / e) / T;
+		}
+	}
+
+	//	одна точка x = mT - m без выделения памяти (для TF1, который вызывает модель по точкам)
+	double Value( double x, const double *p ) const
+	{
+		if (fN > kMaxNodes)
+		{
+			double out;
+			Evaluate(&x, 1, p, &out);
+			return out;
+		}
+
+		double sh[kMaxNodes], ch[kMaxNodes], a[kMaxNodes], b[kMaxNodes], i0k1[kMaxNodes];
+		Nodes(p[1], p[2], sh, ch);
+		double mass = p[3], mt = x + mass;
+		double pt = sqrt(x * (x + 2. * mass));   // = sqrt(mt^2 - m^2) без вычитания (с FMA оно бывает < 0 при x = 0)
+		for (int k = 0; k < fN; k++)
+		{
+			a[k] = pt * sh[k];
+			b[k] = mt * ch[k];
+		}
+		BesselKernels::I0K1(a, b, i0k1, fN);
+
+		double sum = 0;
+		for (int k = 0; k < fN; k++) sum += fW[k] * i0k1[k];
+		return p[0] * mt * sum;
+	}
+
+	//	x[] - точки спектра (mT - m), p[] = {constant, T, beta, mass} как в MyIntegFunc
+	//	если dOut != 0, туда же пишется производная по x (нужна для ошибок по x в chi2)
+	void Evaluate( const double *x, int n, const double *p, double *out, double *dOut = 0 ) const
+	{
+		double con = p[0], mass = p[3];
+
+		std::vector<double> sh(fN), ch(fN);
+		Nodes(p[1], p[2], sh.data(), ch.data());
+
+		// аргументы функций Бесселя во всех узлах и их произведения (BesselKernels)
+		std::vector<double> a(fN), b(fN), i0k1(fN), i1k1(fN), i0k0(fN);
+
+		for (int i = 0; i < n; i++)
+		{
+			double mt = x[i] + mass;
+			double pt = sqrt(x[i] * (x[i] + 2. * mass));
+
+			for (int k = 0; k < fN; k++)
+			{
+				a[k] = pt * sh[k];
+				b[k] = mt * ch[k];
+			}
+
+			double sum = 0, dsum = 0;
+			if (!dOut)
+			{
+				BesselKernels::I0K1(a.data(), b.data(), i0k1.data(), fN);
+				for (int k = 0; k < fN; k++) sum += fW[k] * i0k1[k];
+			}
+			else
+			{
+				BesselKernels::Products(a.data(), b.data(), i0k1.data(), i1k1.data(), i0k0.data(), fN);
+				for (int k = 0; k < fN; k++)
+				{
+					sum += fW[k] * i0k1[k];
+					// dI0/da = I1, dK1/db = -K0 - K1/b, dpt/dmt = mt/pt
+					double di0 = (pt > 0) ? i1k1[k] * sh[k] * mt / pt : 0.5 * mt * sh[k] * sh[k] * i0k1[k];
+					double dk1 = -(i0k0[k] + i0k1[k] / b[k]) * ch[k];
+					dsum += fW[k] * (di0 + dk1);
+				}
+			}
+
+			out[i] = con * mt * sum;
+			if (dOut) dOut[i] = con * (sum + mt * dsum);
+		}
+	}
+
+	//	Значения и производные по параметрам в одном проходе по радиальным узлам:
+	//	f[i], fx[i] = df/dx, fp[3i + j] = df/dp_j и fxp[3i + j] = d2f/dx dp_j для p_j = constant, T, beta.
+	//	Используются тождества I0' = I1, I1' = I0 - I1/a, K1' = -K0 - K1/b, K1'' = K1 (1 + 2/b^2) + K0/b.
+	//	Смешанные производные по x нужны для chi2 с эффективной дисперсией (ошибки по x).
+	void Gradient( const double *x, int n, const double *p, double *f, double *fx, double *fp, double *fxp ) const
+	{
+		double con = p[0], T = p[1], beta = p[2], mass = p[3];
+		double rhoMax = TMath::ATanH(beta);
+
+		std::vector<double> s(fN), c(fN), rhoB(fN);
+		for (int k = 0; k < fN; k++)
+		{
+			double rho = rhoMax * fR[k] / fRadius;
+			s[k] = TMath::SinH(rho) / T;
+			c[k] = TMath::CosH(rho) / T;
+			rhoB[k] = fR[k] / fRadius / (1. - beta * beta);   // d rho / d beta
+		}
+
+		std::vector<double> a(fN), b(fN), P(fN), A(fN), Q(fN), B(fN);
+
+		for (int i = 0; i < n; i++)
+		{
+			double mt = x[i] + mass;
+			double pt = sqrt(x[i] * (x[i] + 2. * mass));
+
+			for (int k = 0; k < fN; k++)
+			{
+				a[k] = pt * s[k];
+				b[k] = mt * c[k];
+			}
+			// P = I0 K1, Q = I0 K0; A = I1 K1 / a, B = I1 K0 / a (конечны при a -> 0)
+			BesselKernels::Products(a.data(), b.data(), P.data(), A.data(), Q.data(), fN, B.data());
+
+			double g = 0, gm = 0, gT = 0, gB = 0, gmT = 0, gmB = 0;
+			for (int k = 0; k < fN; k++)
+			{
+				double Ak = (a[k] > 0) ? A[k] / a[k] : 0.5 * P[k];
+				double Bk = (a[k] > 0) ? B[k] / a[k] : 0.5 * Q[k];
+				double ss = s[k] * s[k], cc = c[k] * c[k];
+
+				double ub  = -Q[k] - P[k] / b[k];                                // du/db
+				double uab = -a[k] * (Bk + Ak / b[k]);                           // d2u/da db
+				double ubb = P[k] * (1. + 2. / (b[k] * b[k])) + Q[k] / b[k];     // d2u/db2
+
+				double um  = Ak * ss * mt + ub * c[k];
+				double uT  = -(a[k] * a[k] * Ak + b[k] * ub) / T;
+				double uB  = rhoB[k] * s[k] * (Ak * pt * pt * c[k] + ub * mt);
+				double umT = -(ss * mt * (P[k] - Bk * b[k] - Ak) + (uab * a[k] + ubb * b[k] + ub) * c[k]) / T;
+				double umB = rhoB[k] * s[k] * (P[k] * c[k] * mt - (Bk + Ak / b[k]) * (ss * mt * mt + pt * pt * cc)
+				                                + ubb * mt * c[k] + ub);
+
+				g += fW[k] * P[k];
+				gm += fW[k] * um;
+				gT += fW[k] * uT;
+				gB += fW[k] * uB;
+				gmT += fW[k] * umT;
+				gmB += fW[k] * umB;
+			}
+
+			f[i] = con * mt * g;
+			fx[i] = con * (g + mt * gm);
+
+			fp[3 * i + 0] = mt * g;
+			fp[3 * i + 1] = con * mt * gT;
+			fp[3 * i + 2] = con * mt * gB;
+
+			fxp[3 * i + 0] = g + mt * gm;
+			fxp[3 * i + 1] = con * (gT + mt * gmT);
+			fxp[3 * i + 2] = con * (gB + mt * gmB);
+		}
+	}
+
+	//	то же для всех точек графика grSpectra[part][centr]
+	void Evaluate( const TGraph *gr, const double *p, double *out ) const
+	{
+		Evaluate(gr->GetX(), gr->GetN(), p, out);
+	}
+};
+
+
+//	модель blastwave без состояния: все параметры передаются аргументами,
+//	общего TF1 и изменяемых param[] нет, поэтому один объект (или его копии в разных TF1)
+//	можно вычислять одновременно из нескольких потоков.
+//	Квадратура - как у MyIntegFunc: Гаусс-Лежандр (BlastWaveBatch) или для kAdaptive адаптивный
+//	интеграл bwfitfunc с той же точностью, что TF1::Integral в MyIntegFunc (свой интегратор на каждый вызов).
+//	Подходит для TF1 (и через него для WrappedMultiTF1) и для прямого вызова из C++:
+//		TF1 *f = new TF1("ifuncx", BlastWaveModel(), xmin, xmax, 4, "BlastWaveModel");
+//		double y = BlastWaveModel()(x, con, T, beta, mass);
+struct BlastWaveModel
+{
+	BlastWaveModel( EQuadrature quad = gQuadrature ):
+		fQuad(quad), fBatch((quad == kAdaptive) ? 32 : quad) {}
+
+	EQuadrature fQuad;
+	BlastWaveBatch fBatch;  // только узлы и веса, после конструктора не меняется
+
+	//	сигнатура TF1: x[0] = mT - m, p[] = {constant, T, beta, mass}
+	double operator() ( const double *x, const double *p ) const
+	{
+		if (fQuad == kAdaptive) return Adaptive(x[0], p);
+		return fBatch.Value(x[0], p);
+	}
+
+	double operator() ( double x, double con, double T, double beta, double mass ) const
+	{
+		double p[4] = {con, T, beta, mass};
+		return (*this)(&x, p);
+	}
+
+	//	все точки спектра сразу
+	void Evaluate( const double *x, int n, const double *p, double *out ) const
+	{
+		if (fQuad != kAdaptive)
+		{
+			fBatch.Evaluate(x, n, p, out);
+			return;
+		}
+		for (int i = 0; i < n; i++) out[i] = Adaptive(x[i], p);
+	}
+
+	//	интеграл по r от 0.0001 до 13 fm, как MyIntegFunc с kAdaptive
+	double Adaptive( double x, const double *p ) const
+	{
+		double param[5] = {p[0], p[1], p[2], p[3], x};
+		auto integrand = [&](double r) { return bwfitfunc(&r, param); };
+		ROOT::Math::IntegratorOneDim integrator(integrand, ROOT::Math::IntegratorOneDimOptions::DefaultIntegratorType(), 1.e-12, 1.e-10);
+		return integrator.Integral(0.0001, 13.0);
+	}
+};
+
+
+//	наибольшее относительное отклонение пакетного интеграла BlastWaveBatch (ядра BesselKernels), которым
+//	считаются модель и chi2 фитов, от адаптивного TF1::Integral на сетке nSteps^3 по (T, beta, mT - m)
+//	для заданных масс. Узлов - как у фитов с quad (для kAdaptive - 32, как у BlastWaveBatch по умолчанию).
+//	Проверяются все пути: Evaluate по всем mT - m сразу, без производной (I0K1) и с ней (Products),
+//	и Value для одной точки (TF1); печатает, где отклонение наибольшее
+double QuadratureDeviation( EQuadrature quad, const double *mass, int nMass,
+                            double Tlo, double Thi, double betaLo, double betaHi,
+                            double xlo, double xhi, int nSteps = 6 )
+{
+	TF1 *funcx = new TF1("funcxQuad", bwfitfunc, 0.01, 10, 5);
+	MyIntegFunc adaptive(funcx, kAdaptive);
+	int nodes = (quad == kAdaptive) ? 32 : quad;
+	BlastWaveBatch batch(nodes);
+
+	vector<double> x(nSteps), out(nSteps), outD(nSteps), dOut(nSteps);
+	for (int iX = 0; iX < nSteps; iX++) x[iX] = xlo + (xhi - xlo) * iX / (nSteps - 1.);
+
+	double worst = 0, worstAt[4] = {0, 0, 0, 0};
+	for (int m = 0; m < nMass; m++)
+	{
+		for (int iT = 0; iT < nSteps; iT++)
+		{
+			for (int iB = 0; iB < nSteps; iB++)
+			{
+				double p[4] = {1., Tlo + (Thi - Tlo) * iT / (nSteps - 1.), 
+				               betaLo + (betaHi - betaLo) * iB / (nSteps - 1.), mass[m]};
+				batch.Evaluate(x.data(), nSteps, p, out.data());
+				batch.Evaluate(x.data(), nSteps, p, outD.data(), dOut.data());
+
+				for (int iX = 0; iX < nSteps; iX++)
+				{
+					double ref = adaptive(&x[iX], p);
+					if (!(ref > 0)) continue;
+					double dev = max(max(fabs(out[iX] / ref - 1.), fabs(outD[iX] / ref - 1.)),
+					                 fabs(batch.Value(x[iX], p) / ref - 1.));
+					if (!(dev <= worst))   // NaN тоже отклонение
+					{
+						worst = dev;
+						worstAt[0] = p[1], worstAt[1] = p[2], worstAt[2] = p[3], worstAt[3] = x[iX];
+					}
+				}
+			}
+		}
+	}
+	delete funcx;
+
+	cout << "BlastWaveBatch " << nodes << " nodes: max |rel. dev.| = " << worst
+	     << " at T = " << worstAt[0] << ", beta = " << worstAt[1] 
+	     << ", mass = " << worstAt[2] << ", mT - m = " << worstAt[3] << endl;
+	return worst;
+}
+
+
+#endif /* __BLASTWAVE_H_ */
@@ -0,0 +1,730 @@
+#ifndef __BLASTWAVECHI2_H_
+#define __BLASTWAVECHI2_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "RConfigure.h"
+#include "Fit/BinData.h"
+#include "Math/IFunction.h"
+#include "HFitInterface.h"
+#include "TGraphErrors.h"
+#ifdef R__USE_IMT
+#include "ROOT/TThreadExecutor.hxx"
+#endif
+#include "BlastWave.h"
+
+
+// Обход независимых слагаемых chi2 (спектров, центральностей) func(0..n-1).
+// При nThreads != 1 (0 - по числу ядер) и сборке ROOT с IMT - параллельно в пуле ROOT::TThreadExecutor.
+// Слагаемые пишут результат по своему индексу и суммируются вызывающим кодом по порядку,
+// поэтому результат не зависит от числа потоков.
+class TermExecutor
+{
+public:
+    explicit TermExecutor( int nThreads = 1 )
+    {
+#ifdef R__USE_IMT
+        if (nThreads != 1) fPool = std::make_shared<ROOT::TThreadExecutor>(nThreads);
+#endif
+    }
+
+    template <class F>
+    void Foreach( unsigned int n, F func ) const
+    {
+#ifdef R__USE_IMT
+        if (fPool && n > 1)
+        {
+            fPool->Foreach(func, ROOT::TSeqU(n));
+            return;
+        }
+#endif
+        for (unsigned int i = 0; i < n; i++) func(i);
+    }
+
+private:
+#ifdef R__USE_IMT
+    std::shared_ptr<ROOT::TThreadExecutor> fPool;
+#endif
+};
+
+
+// chi2 одного спектра через пакетный BlastWaveBatch вместо Chi2Function + WrappedMultiTF1.
+// Параметры те же, что у ifuncx: p[] = {constant, T, beta, mass}.
+// Как и Chi2Function для TGraphErrors, учитывает ошибки по x через эффективную дисперсию:
+// e^2 = ey^2 + (ex * df/dx)^2
+// Градиент по constant, T, beta считается аналитически (BlastWaveBatch::Gradient),
+// с учётом зависимости e^2 от параметров; производная по массе (фиксирована) равна нулю.
+class BlastWaveChi2 : public ROOT::Math::IMultiGradFunction
+{
+public:
+    BlastWaveChi2( const ROOT::Fit::BinData &data, const BlastWaveBatch &batch ):
+        fBatch(&batch)
+    {
+        for (unsigned int i = 0; i < data.Size(); i++)
+        {
+            fX.push_back(data.Coords(i)[0]);
+            fY.push_back(data.Value(i));
+            fEY.push_back(data.Error(i));
+            fEX.push_back(data.HaveCoordErrors() ? data.CoordErrors(i)[0] : 0.);
+        }
+    }
+
+    unsigned int NDim() const { return 4; }
+    unsigned int Size() const { return fX.size(); }
+    ROOT::Math::IMultiGenFunction *Clone() const { return new BlastWaveChi2(*this); }
+
+    // Точки спектра в диапазоне фита; SetY - новые значения (псевдоэксперименты), ошибки прежние
+    const std::vector<double> &X() const { return fX; }
+    const std::vector<double> &Y() const { return fY; }
+    const std::vector<double> &EY() const { return fEY; }
+    void SetY( const double *y ) { fY.assign(y, y + fX.size()); }
+
+    // Копия с точками из [xlo, xhi] (скан диапазона фита без повторного заполнения BinData)
+    BlastWaveChi2 Range( double xlo, double xhi ) const
+    {
+        BlastWaveChi2 range(fBatch);
+        for (unsigned int i = 0; i < fX.size(); i++)
+        {
+            if (fX[i] < xlo || fX[i] > xhi) continue;
+            range.fX.push_back(fX[i]);
+            range.fY.push_back(fY[i]);
+            range.fEX.push_back(fEX[i]);
+            range.fEY.push_back(fEY[i]);
+        }
+        return range;
+    }
+
+    void Gradient( const double *p, double *grad ) const
+    {
+        double chi2;
+        FdF(p, chi2, grad);
+    }
+
+    // chi2 и его градиент за один проход
+    void FdF( const double *p, double &chi2, double *grad ) const
+    {
+        int n = fX.size();
+        std::vector<double> f(n), fx(n), fp(3 * n), fxp(3 * n);
+        fBatch->Gradient(fX.data(), n, p, f.data(), fx.data(), fp.data(), fxp.data());
+
+        chi2 = 0;
+        for (int j = 0; j < 4; j++) grad[j] = 0;
+        for (int i = 0; i < n; i++)
+        {
+            double ex2 = fEX[i] * fEX[i];
+            double e2 = fEY[i] * fEY[i] + ex2 * fx[i] * fx[i];
+            if (e2 <= 0) continue;
+
+            double r = fY[i] - f[i];
+            chi2 += r * r / e2;
+            // d(r^2 / e2) = -2 r df / e2 - r^2 / e2^2 * 2 ex^2 fx dfx
+            for (int j = 0; j < 3; j++)
+                grad[j] += -2. * r * fp[3 * i + j] / e2 - 2. * r * r * ex2 * fx[i] * fxp[3 * i + j] / (e2 * e2);
+        }
+    }
+
+    // Взвешенные невязки r_i = (y_i - f_i) / e_i (chi2 = sum r_i^2) для фита методом наименьших квадратов;
+    // jac[4 i + j] = dr_i / dp_j (p_j = constant, T, beta, mass; по массе - 0) с учётом зависимости e_i от параметров:
+    // dr/dp = -df/dp / e - r ex^2 fx dfx/dp / e^2. Точки с e_i = 0 дают r_i = 0
+    void Residuals( const double *p, double *r, double *jac = 0 ) const
+    {
+        int n = fX.size();
+        if (!jac)
+        {
+            std::vector<double> f(n), df(n);
+            fBatch->Evaluate(fX.data(), n, p, f.data(), df.data());
+            for (int i = 0; i < n; i++)
+            {
+                double e2 = fEY[i] * fEY[i] + pow(fEX[i] * df[i], 2);
+                r[i] = (e2 > 0) ? (fY[i] - f[i]) / sqrt(e2) : 0.;
+            }
+            return;
+        }
+
+        std::vector<double> f(n), fx(n), fp(3 * n), fxp(3 * n);
+        fBatch->Gradient(fX.data(), n, p, f.data(), fx.data(), fp.data(), fxp.data());
+        for (int i = 0; i < n; i++)
+        {
+            double ex2 = fEX[i] * fEX[i];
+            double e2 = fEY[i] * fEY[i] + ex2 * fx[i] * fx[i];
+            for (int j = 0; j < 4; j++) jac[4 * i + j] = 0;
+            if (e2 <= 0)
+            {
+                r[i] = 0;
+                continue;
+            }
+
+            double e = sqrt(e2);
+            r[i] = (fY[i] - f[i]) / e;
+            for (int j = 0; j < 3; j++)
+                jac[4 * i + j] = -fp[3 * i + j] / e - r[i] * ex2 * fx[i] * fxp[3 * i + j] / e2;
+        }
+    }
+
+private:
+    const BlastWaveBatch *fBatch;
+    std::vector<double> fX, fY, fEX, fEY;
+
+    explicit BlastWaveChi2( const BlastWaveBatch *batch ):
+        fBatch(batch) {}
+
+    double DoEval( const double *p ) const
+    {
+        int n = fX.size();
+        std::vector<double> f(n), df(n);
+        fBatch->Evaluate(fX.data(), n, p, f.data(), df.data());
+
+        double chi2 = 0;
+        for (int i = 0; i < n; i++)
+        {
+            double e2 = fEY[i] * fEY[i] + pow(fEX[i] * df[i], 2);
+            if (e2 <= 0) continue;
+            chi2 += pow(fY[i] - f[i], 2) / e2;
+        }
+        return chi2;
+    }
+
+    double DoDerivative( const double *p, unsigned int icoord ) const
+    {
+        double grad[4];
+        Gradient(p, grad);
+        return grad[icoord];
+    }
+
+public:
+    // Оптимальная константа при заданных p[1] = T, p[2] = beta: записывается в p[0], возвращается chi2.
+    // Модель линейна по константе, f = c h, поэтому интеграл считается один раз (c = 1),
+    // дальше минимум по c ищется алгебраически: старт с линейного решения по ey,
+    // затем Ньютон по точной производной (e^2 = ey^2 + c^2 ex^2 hx^2 тоже зависит от c).
+    double ProfileConstant( double *p ) const
+    {
+        int n = fX.size();
+        std::vector<double> h(n), hx(n), q(n);
+        double p1[4] = {1., p[1], p[2], p[3]};
+        fBatch->Evaluate(fX.data(), n, p1, h.data(), hx.data());
+        for (int i = 0; i < n; i++) q[i] = pow(fEX[i] * hx[i], 2);
+
+        double hy = 0, hh = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (fEY[i] <= 0) continue;
+            hy += h[i] * fY[i] / (fEY[i] * fEY[i]);
+            hh += h[i] * h[i] / (fEY[i] * fEY[i]);
+        }
+        double c = (hh > 0) ? hy / hh : 1.;
+
+        double chi2 = 0;
+        for (int iter = 0; iter < 50; iter++)
+        {
+            double d1 = 0, d2 = 0, wy = 0, ww = 0;
+            chi2 = 0;
+            for (int i = 0; i < n; i++)
+            {
+                double D = fEY[i] * fEY[i] + c * c * q[i];
+                if (D <= 0) continue;
+                double r = fY[i] - c * h[i];
+                chi2 += r * r / D;
+                d1 += -2. * h[i] * r / D - 2. * c * q[i] * r * r / (D * D);
+                d2 += 2. * h[i] * h[i] / D + 8. * c * q[i] * h[i] * r / (D * D)
+                    - 2. * q[i] * r * r / (D * D) + 8. * c * c * q[i] * q[i] * r * r / (D * D * D);
+                wy += h[i] * fY[i] / D;
+                ww += h[i] * h[i] / D;
+            }
+
+            // вне области выпуклости - шаг взвешенного МНК с текущими весами;
+            // без точек с ненулевым весом (h = 0 или D = 0) шага нет, c остаётся прежней
+            if (d2 <= 0 && ww <= 0) break;
+            double cNew = (d2 > 0) ? c - d1 / d2 : wy / ww;
+            if (cNew <= 0) cNew = 0.5 * c;
+            bool done = fabs(cNew - c) <= 1.e-12 * fabs(c);
+            c = cNew;
+            if (done) break;
+        }
+
+        p[0] = c;
+        chi2 = 0;
+        for (int i = 0; i < n; i++)
+        {
+            double D = fEY[i] * fEY[i] + c * c * q[i];
+            if (D > 0) chi2 += pow(fY[i] - c * h[i], 2) / D;
+        }
+        return chi2;
+    }
+
+    // Блоки информационной матрицы Гаусса-Ньютона J^T W J, связанные с константой:
+    // info[0] = (c, c), info[1] = (c, T), info[2] = (c, beta)
+    void Information( const double *p, double *info ) const
+    {
+        int n = fX.size();
+        std::vector<double> f(n), fx(n), fp(3 * n), fxp(3 * n);
+        fBatch->Gradient(fX.data(), n, p, f.data(), fx.data(), fp.data(), fxp.data());
+
+        info[0] = info[1] = info[2] = 0;
+        for (int i = 0; i < n; i++)
+        {
+            double e2 = fEY[i] * fEY[i] + pow(fEX[i] * fx[i], 2);
+            if (e2 <= 0) continue;
+            for (int j = 0; j < 3; j++)
+                info[j] += fp[3 * i] * fp[3 * i + j] / e2;
+        }
+    }
+};
+
+
+// Общий chi2 нескольких спектров с общими T и beta, в котором константы профилированы:
+// для заданных x[0] = T, x[1] = beta константа каждого спектра берётся из BlastWaveChi2::ProfileConstant,
+// минимизация идёт только по двум параметрам.
+// В минимуме по константам d chi2 / d c = 0, поэтому градиент по T и beta равен
+// частным производным полного chi2 при оптимальных константах.
+class ProfiledChi2 : public ROOT::Math::IMultiGradFunction
+{
+public:
+    void Add( const BlastWaveChi2 &chi2, double mass )
+    {
+        fChi2.push_back(&chi2);
+        fMass.push_back(mass);
+    }
+
+    unsigned int NDim() const { return 2; }
+    unsigned int NSpectra() const { return fChi2.size(); }
+    ROOT::Math::IMultiGenFunction *Clone() const { return new ProfiledChi2(*this); }
+
+    // Оптимальные константы при x = (T, beta)
+    void Constants( const double *x, double *con ) const
+    {
+        for (unsigned int i = 0; i < fChi2.size(); i++)
+        {
+            double p[4] = {0., x[0], x[1], fMass[i]};
+            fChi2[i]->ProfileConstant(p);
+            con[i] = p[0];
+        }
+    }
+
+    // Полная ковариация (T, beta, c_0, ..., c_{n-1}) размера (2 + n)^2 по ковариации covTB (2 x 2)
+    // профилированного фита: cov(c_i, .) = -(b_i^T V) / a_i, cov(c_i, c_j) = delta_ij / a_i + b_i^T V b_j / (a_i a_j),
+    // где a_i, b_i - блоки (c_i, c_i) и (c_i, T/beta) информационной матрицы
+    void Covariance( const double *x, const double covTB[2][2], double *cov ) const
+    {
+        int n = fChi2.size(), N = 2 + n;
+        std::vector<double> con(n), a(n), b(2 * n);
+        Constants(x, con.data());
+        for (int i = 0; i < n; i++)
+        {
+            double p[4] = {con[i], x[0], x[1], fMass[i]}, info[3];
+            fChi2[i]->Information(p, info);
+            a[i] = info[0];
+            b[2 * i] = info[1];
+            b[2 * i + 1] = info[2];
+        }
+
+        for (int k = 0; k < 2; k++)
+            for (int l = 0; l < 2; l++)
+                cov[k * N + l] = covTB[k][l];
+
+        for (int i = 0; i < n; i++)
+        {
+            double bV[2];
+            for (int l = 0; l < 2; l++)
+                bV[l] = b[2 * i] * covTB[0][l] + b[2 * i + 1] * covTB[1][l];
+
+            for (int l = 0; l < 2; l++)
+                cov[(2 + i) * N + l] = cov[l * N + 2 + i] = -bV[l] / a[i];
+
+            for (int j = 0; j < n; j++)
+            {
+                double bVb = bV[0] * b[2 * j] + bV[1] * b[2 * j + 1];
+                cov[(2 + i) * N + 2 + j] = ((i == j) ? 1. / a[i] : 0.) + bVb / (a[i] * a[j]);
+            }
+        }
+    }
+
+    void FdF( const double *x, double &chi2, double *grad ) const
+    {
+        chi2 = grad[0] = grad[1] = 0;
+        for (unsigned int i = 0; i < fChi2.size(); i++)
+        {
+            double p[4] = {0., x[0], x[1], fMass[i]}, g[4], chi2_i;
+            fChi2[i]->ProfileConstant(p);
+            fChi2[i]->FdF(p, chi2_i, g);
+            chi2 += chi2_i;
+            grad[0] += g[1];
+            grad[1] += g[2];
+        }
+    }
+
+    void Gradient( const double *x, double *grad ) const
+    {
+        double chi2;
+        FdF(x, chi2, grad);
+    }
+
+private:
+    std::vector<const BlastWaveChi2 *> fChi2;
+    std::vector<double> fMass;
+
+    double DoEval( const double *x ) const
+    {
+        double chi2 = 0;
+        for (unsigned int i = 0; i < fChi2.size(); i++)
+        {
+            double p[4] = {0., x[0], x[1], fMass[i]};
+            chi2 += fChi2[i]->ProfileConstant(p);
+        }
+        return chi2;
+    }
+
+    double DoDerivative( const double *x, unsigned int icoord ) const
+    {
+        double grad[2];
+        Gradient(x, grad);
+        return grad[icoord];
+    }
+};
+
+// Совместный chi2 набора центральностей: T и beta - полиномы степени degree
+// по переменной u (масштабированное Npart центральности), par = (a_0..a_d, b_0..b_d),
+// T(u) = sum a_k u^k, beta(u) = sum b_k u^k. Константы каждой центральности профилируются
+// (ProfiledChi2), поэтому гессиан полного фита - "стрелка" (константа связана только
+// со своими T и beta) - исключается аналитически, и минимизатор работает с 2 (degree + 1) параметрами.
+// Центральности можно разбить на nGroups групп (например, системы столкновений): у групп 1..nGroups-1
+// свои сдвиги (dT_g, dbeta_g) = par[2 (degree + 1) + 2 (g - 1) + 0/1] относительно общих полиномов.
+// Вне границ [T_min, T_max], [beta_min, beta_max] chi2 считается на границе плюс квадратичный штраф.
+// Центральности считаются параллельно в nThreads потоках (TermExecutor).
+class CentralityChi2 : public ROOT::Math::IMultiGradFunction
+{
+public:
+    CentralityChi2( int degree, double T_min, double T_max, double beta_min, double beta_max,
+                    int nGroups = 1, int nThreads = 1 ):
+        fDegree(degree), fNGroups(nGroups), fExecutor(nThreads)
+    {
+        fMin[0] = T_min;    fMax[0] = T_max;
+        fMin[1] = beta_min; fMax[1] = beta_max;
+    }
+
+    void Add( const ProfiledChi2 &chi2, double u, int group = 0 )
+    {
+        fChi2.push_back(chi2);
+        fU.push_back(u);
+        fGroup.push_back(group);
+    }
+
+    unsigned int NDim() const { return 2 * (fDegree + 1) + 2 * (fNGroups - 1); }
+    unsigned int NCentr() const { return fChi2.size(); }
+    ROOT::Math::IMultiGenFunction *Clone() const { return new CentralityChi2(*this); }
+
+    const ProfiledChi2 &Term( int c ) const { return fChi2[c]; }
+
+    // Стартовые параметры: полиномы по МНК через (T[c], beta[c]) всех центральностей, сдвиги групп нулевые.
+    // Вырожденная система (разных u меньше degree + 1) не даёт NaN: лишние коэффициенты нулевые
+    void StartValues( const double *T, const double *beta, double *par ) const
+    {
+        int n = fDegree + 1, nc = fChi2.size();
+        for (unsigned int k = 0; k < NDim(); k++) par[k] = 0;
+
+        for (int l = 0; l < 2; l++)
+        {
+            std::vector<double> A(n * n, 0.), b(n, 0.);
+            for (int c = 0; c < nc; c++)
+                for (int k = 0; k < n; k++)
+                {
+                    b[k] += pow(fU[c], k) * ((l == 0) ? T[c] : beta[c]);
+                    for (int m = 0; m < n; m++) A[k * n + m] += pow(fU[c], k + m);
+                }
+
+            // Гаусс с выбором главного элемента
+            for (int k = 0; k < n; k++)
+            {
+                int piv = k;
+                for (int m = k + 1; m < n; m++) if (fabs(A[m * n + k]) > fabs(A[piv * n + k])) piv = m;
+                for (int m = 0; m < n; m++) std::swap(A[k * n + m], A[piv * n + m]);
+                std::swap(b[k], b[piv]);
+                if (fabs(A[k * n + k]) <= 1.e-12 * fabs(A[0])) continue;
+                for (int m = k + 1; m < n; m++)
+                {
+                    double f = A[m * n + k] / A[k * n + k];
+                    for (int q = k; q < n; q++) A[m * n + q] -= f * A[k * n + q];
+                    b[m] -= f * b[k];
+                }
+            }
+            for (int k = n - 1; k >= 0; k--)
+            {
+                double sum = b[k];
+                for (int m = k + 1; m < n; m++) sum -= A[k * n + m] * par[l * n + m];
+                par[l * n + k] = (fabs(A[k * n + k]) > 1.e-12 * fabs(A[0])) ? sum / A[k * n + k] : 0.;
+            }
+        }
+    }
+
+    // Производные (T, beta) центральности c по параметрам: J[0..NDim) - для T, J[NDim..2 NDim) - для beta
+    void Jacobian( int c, double *J ) const
+    {
+        int n = fDegree + 1, N = NDim();
+        for (int k = 0; k < 2 * N; k++) J[k] = 0;
+
+        double uk = 1;
+        for (int k = 0; k < n; k++, uk *= fU[c])
+        {
+            J[k] = uk;
+            J[N + n + k] = uk;
+        }
+        if (fGroup[c] > 0)
+        {
+            J[2 * n + 2 * (fGroup[c] - 1)] = 1;
+            J[N + 2 * n + 2 * (fGroup[c] - 1) + 1] = 1;
+        }
+    }
+
+    // (T, beta) центральности c
+    void TBeta( const double *par, int c, double *x ) const
+    {
+        int N = NDim();
+        std::vector<double> J(2 * N);
+        Jacobian(c, J.data());
+
+        x[0] = x[1] = 0;
+        for (int k = 0; k < N; k++)
+        {
+            x[0] += J[k] * par[k];
+            x[1] += J[N + k] * par[k];
+        }
+    }
+
+    // Ковариация (T, beta) центральности c по ковариации параметров covPar (NDim x NDim)
+    void CovTB( int c, const double *covPar, double covTB[2][2] ) const
+    {
+        int N = NDim();
+        std::vector<double> J(2 * N);
+        Jacobian(c, J.data());
+
+        for (int k = 0; k < 2; k++)
+            for (int l = 0; l < 2; l++)
+            {
+                covTB[k][l] = 0;
+                for (int i = 0; i < N; i++)
+                    for (int j = 0; j < N; j++)
+                        covTB[k][l] += J[k * N + i] * covPar[i * N + j] * J[l * N + j];
+            }
+    }
+
+    void FdF( const double *par, double &chi2, double *grad ) const
+    {
+        int N = NDim(), nc = fChi2.size();
+        std::vector<double> chi2c(nc), gc(2 * nc);
+        fExecutor.Foreach(nc, [&](unsigned int c) {
+            double x[2], xc[2], g[2], chi2_c;
+            TBeta(par, c, x);
+            chi2c[c] = Clamp(x, xc, g);
+
+            double gp[2];
+            fChi2[c].FdF(xc, chi2_c, gp);
+            chi2c[c] += chi2_c;
+            for (int l = 0; l < 2; l++)
+                gc[2 * c + l] = (xc[l] == x[l]) ? g[l] + gp[l] : g[l];
+        });
+
+        chi2 = 0;
+        for (int k = 0; k < N; k++) grad[k] = 0;
+        std::vector<double> J(2 * N);
+        for (int c = 0; c < nc; c++)
+        {
+            chi2 += chi2c[c];
+            Jacobian(c, J.data());
+            for (int k = 0; k < N; k++)
+                grad[k] += gc[2 * c] * J[k] + gc[2 * c + 1] * J[N + k];
+        }
+    }
+
+    void Gradient( const double *par, double *grad ) const
+    {
+        double chi2;
+        FdF(par, chi2, grad);
+    }
+
+private:
+    int fDegree, fNGroups;
+    double fMin[2], fMax[2];
+    std::vector<ProfiledChi2> fChi2;
+    std::vector<double> fU;
+    std::vector<int> fGroup;
+    TermExecutor fExecutor;
+
+    // Проекция x на границы: xc, штраф и его градиент g
+    double Clamp( const double *x, double *xc, double *g ) const
+    {
+        double penalty = 0;
+        for (int l = 0; l < 2; l++)
+        {
+            xc[l] = std::min(std::max(x[l], fMin[l]), fMax[l]);
+            double w = 1e4 / ((fMax[l] - fMin[l]) * (fMax[l] - fMin[l]));
+            penalty += w * (x[l] - xc[l]) * (x[l] - xc[l]);
+            g[l] = 2 * w * (x[l] - xc[l]);
+        }
+        return penalty;
+    }
+
+    double DoEval( const double *par ) const
+    {
+        int nc = fChi2.size();
+        std::vector<double> chi2c(nc);
+        fExecutor.Foreach(nc, [&](unsigned int c) {
+            double x[2], xc[2], g[2];
+            TBeta(par, c, x);
+            chi2c[c] = Clamp(x, xc, g) + fChi2[c](xc);
+        });
+
+        double chi2 = 0;
+        for (int c = 0; c < nc; c++) chi2 += chi2c[c];
+        return chi2;
+    }
+
+    double DoDerivative( const double *par, unsigned int icoord ) const
+    {
+        std::vector<double> grad(NDim());
+        Gradient(par, grad.data());
+        return grad[icoord];
+    }
+};
+
+// Общий chi2 для любого числа спектров с декларативным распределением параметров.
+// Для каждого спектра задаётся map[4]: локальный параметр p[j] (constant, T, beta, mass)
+// берётся из глобального par[map[j]], а при map[j] < 0 - фиксированное значение value[j].
+// Обычный случай (общие T и beta, своя константа, фиксированная масса) - AddSpecies.
+// Слагаемые спектров считаются параллельно в nThreads потоках (TermExecutor).
+class GlobalChi2 : public ROOT::Math::IMultiGradFunction
+{
+public:
+    GlobalChi2( int nPar, const BlastWaveBatch &batch, int nThreads = 1 ):
+        fNPar(nPar), fBatch(&batch), fExecutor(nThreads) {}
+
+    void Add( const ROOT::Fit::BinData &data, const int map[4], const double value[4] )
+    {
+        fTerms.push_back(BlastWaveChi2(data, *fBatch));
+        fMap.push_back({map[0], map[1], map[2], map[3]});
+        fValue.push_back({value[0], value[1], value[2], value[3]});
+    }
+
+    // Спектр gr в диапазоне [xmin, xmax]: своя константа par[parConst], общие par[parT] и par[parBeta]
+    void AddSpecies( const TGraphErrors *gr, double xmin, double xmax, double mass, 
+                     int parConst, int parT = 0, int parBeta = 1 )
+    {
+        ROOT::Fit::DataOptions opt;
+        ROOT::Fit::DataRange range(xmin, xmax);
+        ROOT::Fit::BinData data(opt, range);
+        ROOT::Fit::FillData(data, gr);
+
+        int map[4] = {parConst, parT, parBeta, -1};
+        double value[4] = {0., 0., 0., mass};
+        Add(data, map, value);
+    }
+
+    unsigned int NDim() const { return fNPar; }
+    unsigned int NTerms() const { return fTerms.size(); }
+    ROOT::Math::IMultiGenFunction *Clone() const { return new GlobalChi2(*this); }
+
+    const BlastWaveChi2 &Term( int i ) const { return fTerms[i]; }
+    double Mass( int i ) const { return fValue[i][3]; }
+
+    // Число точек во всех спектрах
+    unsigned int Size() const
+    {
+        unsigned int n = 0;
+        for (const BlastWaveChi2 &term: fTerms) n += term.Size();
+        return n;
+    }
+
+    // Параметры спектра i из глобальных
+    void SetParams( const double *par, int i, double *p ) const
+    {
+        for (int j = 0; j < 4; j++)
+            p[j] = (fMap[i][j] >= 0) ? par[fMap[i][j]] : fValue[i][j];
+    }
+
+    void FdF( const double *par, double &chi2, double *grad ) const
+    {
+        int n = fTerms.size();
+        std::vector<double> chi2i(n), gi(4 * n);
+        fExecutor.Foreach(n, [&](unsigned int i) {
+            double p[4];
+            SetParams(par, i, p);
+            fTerms[i].FdF(p, chi2i[i], &gi[4 * i]);
+        });
+
+        chi2 = 0;
+        for (unsigned int k = 0; k < fNPar; k++) grad[k] = 0;
+        for (int i = 0; i < n; i++)
+        {
+            chi2 += chi2i[i];
+            for (int j = 0; j < 4; j++)
+                if (fMap[i][j] >= 0) grad[fMap[i][j]] += gi[4 * i + j];
+        }
+    }
+
+    void Gradient( const double *par, double *grad ) const
+    {
+        double chi2;
+        FdF(par, chi2, grad);
+    }
+
+    // Невязки всех спектров подряд (Size() значений, BlastWaveChi2::Residuals) и якобиан
+    // jac[i * NDim() + k] = dr_i / dpar_k; спектры считаются параллельно, строки у каждого свои
+    void Residuals( const double *par, double *r, double *jac = 0 ) const
+    {
+        int n = fTerms.size();
+        std::vector<unsigned int> offset(n + 1, 0);
+        for (int i = 0; i < n; i++) offset[i + 1] = offset[i] + fTerms[i].Size();
+        if (jac) std::fill(jac, jac + offset[n] * fNPar, 0.);
+
+        fExecutor.Foreach(n, [&](unsigned int i) {
+            double p[4];
+            SetParams(par, i, p);
+            if (!jac)
+            {
+                fTerms[i].Residuals(p, r + offset[i]);
+                return;
+            }
+
+            unsigned int m = fTerms[i].Size();
+            std::vector<double> jt(4 * m);
+            fTerms[i].Residuals(p, r + offset[i], jt.data());
+            for (unsigned int k = 0; k < m; k++)
+                for (int j = 0; j < 4; j++)
+                    if (fMap[i][j] >= 0) jac[(offset[i] + k) * fNPar + fMap[i][j]] += jt[4 * k + j];
+        });
+    }
+
+private:
+    unsigned int fNPar;
+    const BlastWaveBatch *fBatch;
+    std::vector<BlastWaveChi2> fTerms;
+    std::vector<std::array<int, 4>> fMap;
+    std::vector<std::array<double, 4>> fValue;
+    TermExecutor fExecutor;
+
+    double DoEval( const double *par ) const
+    {
+        int n = fTerms.size();
+        std::vector<double> chi2i(n);
+        fExecutor.Foreach(n, [&](unsigned int i) {
+            double p[4];
+            SetParams(par, i, p);
+            chi2i[i] = fTerms[i](p);
+        });
+
+        double chi2 = 0;
+        for (int i = 0; i < n; i++) chi2 += chi2i[i];
+        return chi2;
+    }
+
+    double DoDerivative( const double *par, unsigned int icoord ) const
+    {
+        std::vector<double> grad(fNPar);
+        Gradient(par, grad.data());
+        return grad[icoord];
+    }
+};
+
+
+#endif /* __BLASTWAVECHI2_H_ */
@@ -1,5 +1,25 @@
+#ifndef __BLASTWAVEFIT_H_
+#define __BLASTWAVEFIT_H_
+
 #include "def.h"
 #include "WriteReadFiles.h"
+#include "BlastWaveTable.h"
+#include "AnalysisContext.h"
+#include "BlastWaveChi2.h"
+#include "ContourScan.h"
+#include "ProfileInterval.h"
+#include "FitCache.h"
+#include "FitSettings.h"
+#include "LeastSquares.h"
+#include "CovarianceChi2.h"
+#include <limits>
+#include <memory>
+#include <sstream>
+#include "Fit/Chi2FCN.h"
+#include "Math/WrappedMultiTF1.h"
+#include "TROOT.h"
+#include "Math/MinimizerOptions.h"
+#include "TMinuit.h"
 
 
 using namespace std;
@@ -8,42 +28,77 @@ using namespace std;
 class BlastWaveFit {
 public:
 
-    bool isContour = true;
+    bool isContour = false; // контуры 1..nSigmaContour сигм в (beta, T) после фитов case 0 и 1
+    int nSigmaContour = 3;
     bool isDraw = true;
+    bool isInterval = false;    // интервалы профильного правдоподобия T и beta после фитов case 0 и 1
+    int intervalThreads = 0;    // потоков для границ интервалов (0 - по числу ядер)
     
     double outParams[N_PARTS][N_CENTR][4];
     double outParamsErr[N_PARTS][N_CENTR][4];
     double paramsSystematics[N_PARTS][N_CENTR][4];
+    double outParamsInterval[N_PARTS][N_CENTR][4] = {}; // isInterval: ошибки со знаком T-, T+, beta-, beta+
+    int outIntervalLimit[N_PARTS][N_CENTR] = {};         // isInterval: бит k - граница k упёрлась в границу фита
     double lLimitMult = 0.5, rLimitMult = 1.5; // for parLimits in case 4 (Systematic)
     double lLimitMultPi = 0.5, rLimitMultPi = 1.; // for parLimits in case 4 (Systematic Pi meson)
+    bool useTables = false; // интеграл из предрасчитанных таблиц BlastWaveTable вместо MyIntegFunc
+    int nThreads = 1;       // число потоков для фитов (0 - по числу ядер)
+    string minimizer = "";  // минимизатор для фитов (пусто - final.minimizer из настроек или Minuit2); TMinuit всегда заменяется на Minuit2
+    AnalysisContext *context = 0; // система для фита (0 - глобальные массивы def.h и systN)
+    bool useCache = false;  // результаты фитов из FitCache (output/cache), если такой фит уже был
+    FitCache cache;
+    const FitSettings *settings = 0;  // границы, диапазоны, старт, минимизатор (0 - FitSettings::Default())
+    bool leastSquares = false;  // фиты спектров Левенбергом-Марквардтом по невязкам BlastWaveChi2 вместо TGraph::Fit
+    bool useCovariance = false; // chi2 с систематикой spectraSys в ковариации точек (CovarianceChi2, тоже Левенберг-Марквардт);
+                                // ошибки параметров - из этой ковариации, без нормировки на chi2/NDF
+    double sysCorrelation = 1.; // доля систематики, общая для точек спектра (CovarianceChi2::sysCorrelation)
     
 
     void Fit( int initParamsType = 0 )
     {    
+        fCtx = context ? context : &AnalysisContext::Global();
+        fGlobalRead = false;
+        fSettings = settings ? settings : &FitSettings::Default();
+        // до создания первого TF1: иначе объекты ROOT не регистрируются потокобезопасно
+        if (nThreads != 1) ROOT::EnableThreadSafety();
+        if (!fSettings->valid)
+        {
+            // файл не найден или с ошибками - как без settings (в Default только прочитанные без ошибок строки)
+            cout << "BlastWaveFit: invalid fit settings, using FitSettings::Default()" << endl;
+            fSettings = &FitSettings::Default();
+        }
+
+        // массивы контекста вместо глобальных из def.h
+        int systN = fCtx->systN;
+        auto ifuncx = fCtx->ifuncx;
+        double *xmin = fCtx->xmin, *xmax = fCtx->xmax;
+        fSettings->ApplyRanges(systN, xmin, xmax);
+        FitSeeds seeds;     // seed.* только на этот Fit
+        seeds.Save(fCtx->handT, fCtx->handBeta, fCtx->handConst);
+        fSettings->ApplySeeds(systN, fCtx->handT, fCtx->handBeta, fCtx->handConst);
+
         // ++++++ Read data +++++++++++++++++++++++++++++++++++++
 
         // Чтение данных в зависимости от системы
-        if (systN == 0) 
-            ReadFromFileAuAu(); // Для системы AuAu
-        else                    // Для других систем
-            for (int part: PARTS) ReadFromFile(part, systN);
+        fCtx->ReadSpectra();
 
         // +++++++++ Fit +++++++++++++++++++++++++++++++++++++++
 
         // TVirtualFitter::SetDefaultFitter("Minuit");  
         // TMinuit* minuit = new TMinuit(5); 
-        gMinuit = new TMinuit(5);  // Инициализация глобального Minuit
-        gMinuit->SetPrintLevel(1); // Включить отладочный вывод
-        // auto funcx = new TF1("funcx", bwfitfunc, 0.01, 10, 5);
-        auto funcx = new TF1("funcx", bwfitfunc, 0.01, 10, 5);
+        if (!context) {
+            gMinuit = new TMinuit(5);  // Инициализация глобального Minuit
+            gMinuit->SetPrintLevel(1); // Включить отладочный вывод
+        }
 
         // gMinuit->SetMaxIterations(1000); // Увеличьте число итераций
         // gMinuit->SetPrecision(1e-5);     // Повысьте точность
 
-        funcx->SetParameters(2,1);
-        funcx->SetParNames("constant", "T", "beta", "mass", "pt");
-        MyIntegFunc *integ = new MyIntegFunc(funcx);
+        // у каждого ifuncx своя копия модели без общего состояния
+        BlastWaveModel model;
 
+        // Подготовка (последовательно): создание TF1, начальные параметры и границы
+        vector<pair<int, int>> tasks;
         for (int part: PARTS)
         {  
             for (int j = 0; j < N_CENTR_SYST[systN]; j++) {
@@ -51,175 +106,584 @@ public:
    
                 // cout << "PART: " << part << "   CENTR: " << centr << endl;
                 string ifuncxName = "MyIntegFunc_" + to_string(part) + "_" + to_string(centr);
-                ifuncx[part][centr] = new TF1("ifuncx", integ, xmin[part], xmax[part], 4, ifuncxName.c_str());
+                if (useTables)
+                    ifuncx[part][centr] = new TF1("ifuncx", BlastWaveTableFunc(GetBlastWaveTable(part)), xmin[part], xmax[part], 4, ifuncxName.c_str());
+                else
+                    ifuncx[part][centr] = new TF1("ifuncx", model, xmin[part], xmax[part], 4, ifuncxName.c_str());
+
+                if (SetupFit(part, centr, initParamsType)) 
+                    tasks.push_back(make_pair(part, centr));
+            }
+        }
+
+        // Фиты (независимы для каждой пары частица-центральность) через TaskScheduler.
+        // Вывод каждого фита собирается отдельно и печатается в исходном порядке.
+        // Минимизатор - свой у этого Fit (FitGraph), глобальный по умолчанию не читается и не меняется:
+        // фиты других контекстов могут идти одновременно. TMinuit не потокобезопасен, поэтому вместо него
+        // Minuit2 при любом nThreads (результат не зависит от числа потоков); без minimizer и final.minimizer - Minuit2
+        string minimizerType = minimizer, minimizerAlgo;
+        if (minimizerType.empty()) fSettings->Minimizer(systN, "final", minimizerType, minimizerAlgo);
+        fMinimizer = FitMinimizerOptions(minimizerType, minimizerAlgo);
+
+        vector<string> logs(tasks.size());
+        TaskScheduler::Run(tasks.size(), nThreads, [&](int i) {
+            logs[i] = RunFit(tasks[i].first, tasks[i].second, initParamsType);
+        });
+        for (const string &log: logs) cout << log;
+
+        if (isContour && (initParamsType == 0 || initParamsType == 1))
+            Contours(tasks);
+        if (isInterval && (initParamsType == 0 || initParamsType == 1))
+            Intervals(tasks);
+        seeds.Restore(fCtx->handT, fCtx->handBeta, fCtx->handConst);
+    }
 
-                switch(initParamsType)
+    // Минимизатор последнего Fit (для перефитов с тем же минимизатором, например Systematics)
+    const ROOT::Math::MinimizerOptions &Minimizer() const { return fMinimizer; }
+
+private:
+
+    AnalysisContext *fCtx = 0;  // контекст текущего Fit
+    bool fGlobalRead = false;   // параметры глобального фита уже прочитаны из файла в этом Fit
+    const FitSettings *fSettings = 0;
+    ROOT::Math::MinimizerOptions fMinimizer;  // минимизатор фитов текущего Fit
+
+    // Начальные параметры и границы ifuncx[part][centr]; false - фит пропускается (нет параметров)
+    bool SetupFit( int part, int centr, int initParamsType )
+    {
+        int systN = fCtx->systN;
+        auto ifuncx = fCtx->ifuncx;
+        auto paramsGlobal = fCtx->paramsGlobal;
+        auto handConst = fCtx->handConst;
+
+        switch(initParamsType)
+        {
+            case 0: { /* DEFAULT */
+                // ================== version1 Params from Global fit ============================
+                // Границы - от параметров глобального фита из файла; старт - из памяти (сошедшиеся фиты
+                // этой сессии), если есть, иначе те же параметры из файла
+                double seeds[5] = {}, parResults[5];
+                if (!fGlobalRead)
                 {
-                    case 0: { /* DEFAULT */
-                        // ================== version1 Params from Global fit ============================
-                        double parResults[5];
-
-                        std::string filename = "output/parameters/ALL_GlobalBWparams_" + std::string(systNamesT[systN]) + ".txt";
-                        // std::string filename = "output/parameters/ALL_FinalBWparams_" + std::string(systNamesT[systN]) + ".txt";
-                        ReadGlobalParams(systN, paramsGlobal, filename.c_str());
-                        getGlobalParams(part, centr, parResults);
-                        if (parResults[0] == 0) continue;
-                            
-                        // parResults[2] = (parResults[2] > 0.9) ? 0.9 : parResults[2];
-                        // ifuncx[part][centr]->SetParameters(parResults);
-                        // for (int par = 0; par < 3; par++)
-                        // {
-                        //     ifuncx[part][centr]->SetParLimits(par, parResults[par] * 0.5, parResults[par] * 1.5);
-                        //     if (part <= 1 && par == 2) 
-                        //         ifuncx[part][centr]->SetParLimits(par, parResults[par] * 0.5, parResults[par] * 1.5);
-                        // }
-
-                        // Установка начальных параметров
-                        ifuncx[part][centr]->SetParameters(parResults);
-                        
-                        // Фиксируем параметры T (индекс 1) и beta (индекс 2)
-                        // ifuncx[part][centr]->FixParameter(1, parResults[1]); // Фиксируем T
-                        // ifuncx[part][centr]->FixParameter(2, parResults[2]); // Фиксируем beta
-                        if (systN == 0) {
-                            // ifuncx[part][centr]->FixParameter(1, parResults[1]); // Фиксируем T
-                            // ifuncx[part][centr]->FixParameter(2, parResults[2]); // Фиксируем beta
-                            ifuncx[part][centr]->SetParLimits(1, parResults[1] * 0.99, parResults[1] * 1.5);
-                            ifuncx[part][centr]->SetParLimits(2, parResults[2] * 0.99, parResults[2] * 1.5);
-                            ifuncx[part][centr]->SetParLimits(0, parResults[0] * 0, parResults[0] * 1000); // Широкие границы для константы
-                        } else if (systN == 1) {
-                            ifuncx[part][centr]->SetParLimits(1, parResults[1] * 0.7, parResults[1] * 1.3); // T ±1%
-                            ifuncx[part][centr]->SetParLimits(2, parResults[2] * 0.7, parResults[2] * 1.3); // beta ±1%
-                            ifuncx[part][centr]->SetParLimits(0, parResults[0] * 0, parResults[0] * 300); // Широкие границы для константы
-                        } else if (systN == 2) {
-                            ifuncx[part][centr]->SetParLimits(1, parResults[1] * 0.7, parResults[1] * 1.1); // T ±1%
-                            ifuncx[part][centr]->SetParLimits(2, parResults[2] * 0.7, parResults[2] * 1.1); // beta ±1%
-                            ifuncx[part][centr]->SetParLimits(0, parResults[0] * 0, parResults[0] * 1000); // Широкие границы для константы
-                        } else if (systN == 3) {
-                            // ifuncx[part][centr]->FixParameter(1, parResults[1]); // Фиксируем T
-                            ifuncx[part][centr]->SetParLimits(1, parResults[1] * 0.99, parResults[1] * 1.3); // T ±1%
-                            ifuncx[part][centr]->SetParLimits(2, parResults[2] * 0.99, parResults[2] * 1.3); // beta ±1%
-                            ifuncx[part][centr]->SetParLimits(0, parResults[0] * 0, parResults[0] * 300); // Широкие границы для константы
-                        } else if (systN == 4) {
-                            // ifuncx[part][centr]->FixParameter(1, parResults[1]); // Фиксируем T
-                            ifuncx[part][centr]->SetParLimits(1, parResults[1] * 0.99, parResults[1] * 1.3); // T ±1%
-                            ifuncx[part][centr]->SetParLimits(2, parResults[2] * 0.99, parResults[2] * 1.3); // beta ±1%
-                            ifuncx[part][centr]->SetParLimits(0, parResults[0] * 0, parResults[0] * 100); // Широкие границы для константы
-                        }
-                        
-                        ifuncx[part][centr]->FixParameter(3, masses[part]); // masses
-
-                        TFitResultPtr fitResult = grSpectra[part][centr]->Fit(ifuncx[part][centr], "QR+S", "", xmin[part], xmax[part]);
-
-                        // Проверяем валидность результата
-                        if (fitResult->IsValid()) {
-
-                            double chi2 = fitResult->Chi2();
-                            int ndf = fitResult->Ndf();
-                            double chi2_ndf = (ndf > 0) ? chi2 / ndf : -1;
-
-                            std::cout << part 
-                                      << centr 
-                                      << " Chi2/NDF = " << chi2_ndf 
-                                      << " (Chi2 = " << chi2 
-                                      << ", NDF = " << ndf << ")\n" 
-                                      << std::endl;
-                        }
-                        break;
-
-                    } case 1: {
-                        // ================== version2 Params from individual fit results =====================
-                        double parResults[4];
-                        ReadParams(part, centr, parResults);
-                        if (parResults[0] == 0)
-                            continue;
-                            
-                        ifuncx[part][centr]->SetParameters(parResults);
-                        for (int par = 0; par < 3; par++)
-                        {
-                            ifuncx[part][centr]->SetParLimits(par, parResults[par] * 0.6, parResults[par] * 1.5);
-                        }
-
-                        ifuncx[part][centr]->FixParameter(3, masses[part]);
-                        grSpectra[part][centr]->Fit(ifuncx[part][centr],  "QR+", "", xmin[part], xmax[part]);
-                        break;
-
-                    } case 2: {
-                        // ================= version 2 Params with limits =================================
-                        double customParams[4] = {con[part], 0.09, 0.75, masses[part]};
-                        ifuncx[part][centr]->SetParameters(customParams);
-                        ifuncx[part][centr]->SetParLimits(0, conmin[part], conmax[part]);
-                        ifuncx[part][centr]->SetParLimits(1, 0.8, 0.14);	
-                        ifuncx[part][centr]->SetParLimits(2, 0.4, 0.8);	
-                        ifuncx[part][centr]->FixParameter(3, masses[part]);	//	mass
-                        grSpectra[part][centr]->Fit(ifuncx[part][centr],  "QR+", "", xmin[part], xmax[part]);
-                        break;
-
-                    } case 3: {
-                        // ================= version 3 hand Params without Fit =============================+==
-                        double handParams[4] = {handConst[part][centr], TCuAu[centr], betaCuAu[centr], masses[part]};
-                        ifuncx[part][centr]->SetParameters(handParams);
-                        break;
-
-                    } case 4: {
-                        // ================= version 4 Params For Systematics =================================    
-                        paramsSystematics[part][centr][2] = (paramsSystematics[part][centr][2] > 0.95) ? 0.95 : paramsSystematics[part][centr][2];
-                        ifuncx[part][centr]->SetParameters(paramsSystematics[part][centr]);
-                        for (int par = 0; par < 3; par++)
-                        {
-                            if (paramsSystematics[part][centr][par] * rLimitMult > 0.95) rLimitMult = 0.95 / paramsSystematics[part][centr][par];
-                            ifuncx[part][centr]->SetParLimits(par, paramsSystematics[part][centr][par] * lLimitMult, paramsSystematics[part][centr][par] * rLimitMult);
-                            cout << paramsSystematics[part][centr][par] * lLimitMult << "   " << paramsSystematics[part][centr][par] * rLimitMult << endl;
-                            // if (part <= 1 && par == 2) {
-                            //     double rl = paramsSystematics[part][centr][par] * rLimitMultPi;
-
-                            //     if (rl > 0.95) rl = 0.95;
-                            //     ifuncx[part][centr]->SetParLimits(par, paramsSystematics[part][centr][par] * lLimitMultPi, rl);
-                            // }  
-                        }
-
-                        ifuncx[part][centr]->FixParameter(3, masses[part]);
-                        grSpectra[part][centr]->Fit(ifuncx[part][centr],  "QR+", "", xmin[part], xmax[part]);
-                        break;
+                    std::string filename = "output/parameters/ALL_GlobalBWparams_" + std::string(systNamesT[systN]) + ".txt";
+                    // std::string filename = "output/parameters/ALL_FinalBWparams_" + std::string(systNamesT[systN]) + ".txt";
+                    ReadGlobalParams(systN, paramsGlobal, filename.c_str());
+                    fGlobalRead = true;
+                }
+                getGlobalParams(part, centr, seeds, paramsGlobal);
+                if (!fCtx->warmStart.SeedSpecies(systN, part, centr, parResults))
+                    std::copy(seeds, seeds + 4, parResults);
+                if (seeds[0] == 0) std::copy(parResults, parResults + 4, seeds); // глобального фита нет - от старта
+                if (parResults[0] == 0) return false;
+                    
+                // Установка начальных параметров
+                ifuncx[part][centr]->SetParameters(parResults);
+
+                // Границы в долях стартовых значений глобального фита или фиксация (final.const, final.T, final.beta)
+                const string limitKeys[3] = {"final.const", "final.T", "final.beta"};
+                for (int par = 0; par < 3; par++)
+                {
+                    double lo, hi;
+                    bool fix;
+                    if (fSettings->Limits(systN, centr, part, limitKeys[par], lo, hi, &fix))
+                    {
+                        ifuncx[part][centr]->SetParLimits(par, seeds[par] * lo, seeds[par] * hi);
+                        // старт из памяти - внутри границ
+                        ifuncx[part][centr]->SetParameter(par, min(max(parResults[par], seeds[par] * lo), seeds[par] * hi));
                     }
+                    else if (fix)
+                        ifuncx[part][centr]->FixParameter(par, parResults[par]);
                 }
                 
-                ifuncx[part][centr]->SetLineColor(centrColors[centr]);
-                
+                ifuncx[part][centr]->FixParameter(3, masses[part]); // masses
+                break;
+
+            } case 1: {
+                // ================== version2 Params from individual fit results =====================
+                // границы - от параметров из BWparams.txt, память сессии - только старт
+                double seeds[4] = {}, parResults[4];
+                ReadParams(part, centr, seeds, "output/txtParams/BWparams.txt", systN);
+                if (!fCtx->warmStart.SeedSpecies(systN, part, centr, parResults))
+                    std::copy(seeds, seeds + 4, parResults);
+                if (seeds[0] == 0) std::copy(parResults, parResults + 4, seeds);
+                if (parResults[0] == 0)
+                    return false;
+                    
+                ifuncx[part][centr]->SetParameters(parResults);
+                for (int par = 0; par < 3; par++)
+                {
+                    ifuncx[part][centr]->SetParLimits(par, seeds[par] * 0.6, seeds[par] * 1.5);
+                    ifuncx[part][centr]->SetParameter(par, min(max(parResults[par], seeds[par] * 0.6), seeds[par] * 1.5));
+                }
 
-        // +++++++++ Metrics ++++++++++++++++++++++++++++++++++++
+                ifuncx[part][centr]->FixParameter(3, masses[part]);
+                break;
+
+            } case 2: {
+                // ================= version 2 Params with limits =================================
+                double customParams[4] = {con[part], 0.09, 0.75, masses[part]};
+                ifuncx[part][centr]->SetParameters(customParams);
+                ifuncx[part][centr]->SetParLimits(0, conmin[part], conmax[part]);
+                ifuncx[part][centr]->SetParLimits(1, 0.8, 0.14);	
+                ifuncx[part][centr]->SetParLimits(2, 0.4, 0.8);	
+                ifuncx[part][centr]->FixParameter(3, masses[part]);	//	mass
+                break;
+
+            } case 3: {
+                // ================= version 3 hand Params without Fit =============================+==
+                double handParams[4] = {handConst[part][centr], TCuAu[centr], betaCuAu[centr], masses[part]};
+                ifuncx[part][centr]->SetParameters(handParams);
+                break;
+
+            } case 4: {
+                // ================= version 4 Params For Systematics =================================    
+                paramsSystematics[part][centr][2] = (paramsSystematics[part][centr][2] > 0.95) ? 0.95 : paramsSystematics[part][centr][2];
+                ifuncx[part][centr]->SetParameters(paramsSystematics[part][centr]);
+                for (int par = 0; par < 3; par++)
+                {
+                    if (paramsSystematics[part][centr][par] * rLimitMult > 0.95) rLimitMult = 0.95 / paramsSystematics[part][centr][par];
+                    ifuncx[part][centr]->SetParLimits(par, paramsSystematics[part][centr][par] * lLimitMult, paramsSystematics[part][centr][par] * rLimitMult);
+                    cout << paramsSystematics[part][centr][par] * lLimitMult << "   " << paramsSystematics[part][centr][par] * rLimitMult << endl;
+                    // if (part <= 1 && par == 2) {
+                    //     double rl = paramsSystematics[part][centr][par] * rLimitMultPi;
+
+                    //     if (rl > 0.95) rl = 0.95;
+                    //     ifuncx[part][centr]->SetParLimits(par, paramsSystematics[part][centr][par] * lLimitMultPi, rl);
+                    // }  
+                }
+
+                ifuncx[part][centr]->FixParameter(3, masses[part]);
+                break;
+            }
+        }
+        
+        ifuncx[part][centr]->SetLineColor(centrColors[centr]);
+        return true;
+    }
+
+    // Фит одной пары частица-центральность и метрики; пишет только outParams[part][centr],
+    // outParamsErr[part][centr] и свой ifuncx, поэтому может выполняться параллельно
+    string RunFit( int part, int centr, int initParamsType )
+    {
+        auto grSpectra = fCtx->grSpectra;
+        auto ifuncx = fCtx->ifuncx;
+        double *xmin = fCtx->xmin, *xmax = fCtx->xmax;
+
+        ostringstream log;
 
-                double *params = ifuncx[part][centr]->GetParameters();
-                const double *paramsErr = ifuncx[part][centr]->GetParErrors();
-                std::copy(params, params + 4, outParams[part][centr]);
-                std::copy(paramsErr, paramsErr + 4, outParamsErr[part][centr]);
+        if (initParamsType == 0)
+        {
+            // Проверяем валидность результата
+            if (FitSpectrum(part, centr)) {
 
-                // NormalizeErrors on chi2/NDF
                 double chi2 = ifuncx[part][centr]->GetChisquare();
-                double ndf = ifuncx[part][centr]->GetNDF();
-                double chi2Ndf = chi2 / ndf;
-                for (int i = 0; i < 3; i++ )
-                {
-                    outParamsErr[part][centr][i] *= sqrt(chi2Ndf);
-                }
+                int ndf = ifuncx[part][centr]->GetNDF();
+                double chi2_ndf = (ndf > 0) ? chi2 / ndf : -1;
+
+                log << part 
+                    << centr 
+                    << " Chi2/NDF = " << chi2_ndf 
+                    << " (Chi2 = " << chi2 
+                    << ", NDF = " << ndf << ")\n" 
+                    << std::endl;
+
+                fCtx->warmStart.StoreSpecies(fCtx->systN, part, centr, ifuncx[part][centr]->GetParameters());
+            }
+        }
+        else if (initParamsType != 3)   // case 3 - параметры без фита
+        {
+            // варианты систематики (case 4) не используются как старт для основных фитов
+            if (FitSpectrum(part, centr) && initParamsType != 4)
+                fCtx->warmStart.StoreSpecies(fCtx->systN, part, centr, ifuncx[part][centr]->GetParameters());
+        }
+
+        // +++++++++ Metrics ++++++++++++++++++++++++++++++++++++
+
+        double *params = ifuncx[part][centr]->GetParameters();
+        const double *paramsErr = ifuncx[part][centr]->GetParErrors();
+        std::copy(params, params + 4, outParams[part][centr]);
+        std::copy(paramsErr, paramsErr + 4, outParamsErr[part][centr]);
+
+        // NormalizeErrors on chi2/NDF
+        double chi2 = ifuncx[part][centr]->GetChisquare();
+        double ndf = ifuncx[part][centr]->GetNDF();
+        double chi2Ndf = chi2 / ndf;
+        for (int i = 0; i < 3 && !useCovariance; i++ )
+        {
+            outParamsErr[part][centr][i] *= sqrt(chi2Ndf);
+        }
+
+        int N = 0, fitN = 0;
+        double *x, *y, d = 0;
+        x = grSpectra[part][centr]->GetX();
+        y = grSpectra[part][centr]->GetY();
+        N = grSpectra[part][centr]->GetN();
+
+        for (int i = 0; i < N; i++)
+        {
+            if (x[i] >= xmin[part] && x[i] <= xmax[part])
+            {
+                d += pow((y[i] - ifuncx[part][centr]->Eval(x[i])) / y[i], 2);
+                fitN++;
+            }
+        }
+        d = sqrt(d) / fitN;
+
+        log << part << " " << centr << "  " << d << " " << chi2Ndf << endl;
 
-                int N = 0, fitN = 0;
-                double *x, *y, d = 0;
-                x = grSpectra[part][centr]->GetX();
-                y = grSpectra[part][centr]->GetY();
-                N = grSpectra[part][centr]->GetN();
+        return log.str();
+    }
+
+    // Фит ifuncx[part][centr]; с useCache результат того же фита (данные, модель, старт, границы) берётся из кэша
+    bool FitSpectrum( int part, int centr )
+    {
+        TGraphErrors *gr = fCtx->grSpectra[part][centr];
+        TF1 *f = fCtx->ifuncx[part][centr];
+        double *xmin = fCtx->xmin, *xmax = fCtx->xmax;
+
+        if (leastSquares || useCovariance)
+        {
+            // интеграл всегда BlastWaveBatch (аналитический якобиан), таблицы не используются;
+            // систематика и её корреляция входят в ключ кэша через опцию
+            const double *sys = useCovariance ? fCtx->spectraSys[part][centr] : 0;
+            ostringstream option;
+            option.precision(17);
+            option << "LM";
+            if (sys)
+            {
+                option << " COV " << sysCorrelation;
+                for (int i = 0; i < gr->GetN() && i < MAX_POINTS; i++) option << " " << sys[i];
+            }
+            string key = cache.Key(gr, f, xmin[part], xmax[part], option.str(), "BlastWaveBatch " + to_string((int)gQuadrature));
+            FitCacheEntry e;
+            if (!useCache || !cache.Load(key, e) || e.nPar != f->GetNpar())
+            {
+                e = FitLeastSquares(gr, f, xmin[part], xmax[part], sys);
+                if (useCache) cache.Store(key, e);
+            }
+            FitCache::Apply(e, f);
+            FitCache::Attach(gr, f, "QR+S");    // как после gr->Fit ниже
+            return e.valid;
+        }
+
+        if (!useCache)
+        {
+            TFitResultPtr fitResult = FitGraph(gr, f, "QR+S", xmin[part], xmax[part], fMinimizer);
+            return fitResult->IsValid();
+        }
+
+        string modelId = useTables ? "BlastWaveTable " + particles[part] : "BlastWaveModel " + to_string((int)gQuadrature);
+        return cache.Fit(gr, f, "QR+S", xmin[part], xmax[part], modelId, fMinimizer);
+    }
+
+    // Фит gr на [xlo, xhi] функцией f (старт, границы и фиксированные параметры из f) через LevenbergMarquardt;
+    // sys - систематика точек gr для CovarianceChi2 (0 - BlastWaveChi2 без неё)
+    FitCacheEntry FitLeastSquares( TGraphErrors *gr, TF1 *f, double xlo, double xhi, const double *sys = 0 ) const
+    {
+        ROOT::Fit::DataOptions opt;
+        ROOT::Fit::DataRange range(xlo, xhi);
+        ROOT::Fit::BinData data(opt, range);
+        ROOT::Fit::FillData(data, gr);
+        BlastWaveBatch batch;
+
+        int nPar = f->GetNpar();
+        LevenbergMarquardt lm;
+        lm.SetParameters(nPar, f->GetParameters());
+        for (int i = 0; i < nPar; i++)
+        {
+            // как в TF1: lo >= hi (не оба нуля) - параметр фиксирован
+            double lo, hi;
+            f->GetParLimits(i, lo, hi);
+            if (lo * hi != 0 && lo >= hi) lm.Fix(i);
+            else if (lo < hi) lm.SetLimits(i, lo, hi);
+        }
+        LeastSquaresResult res;
+        int nPoints;
+        if (!sys)
+        {
+            BlastWaveChi2 chi2(data, batch);
+            res = lm.Minimize(chi2);
+            nPoints = chi2.Size();
+        }
+        else
+        {
+            CovarianceChi2 chi2(4, batch);
+            chi2.sysCorrelation = sysCorrelation;
+            chi2.AddSpecies(gr, sys, xlo, xhi, f->GetParameter(3), 0, 1, 2);
+            chi2.Factorize(f->GetParameters());
+            res = lm.Minimize(chi2);
+            // эффективная дисперсия в найденной точке и повторный фит с уже близкого старта
+            if (res.valid && chi2.Factorize(res.par.data()))
+            {
+                lm.SetValues(res.par.data());
+                res = lm.Minimize(chi2);
+            }
+            nPoints = chi2.Size();
+        }
+
+        FitCacheEntry e;
+        e.valid = res.valid;
+        e.nPar = nPar;
+        e.par = res.par;
+        e.err = res.err;
+        e.cov = res.cov;
+        e.chi2 = res.chi2;
+        e.nPoints = nPoints;
+        e.ndf = e.nPoints - res.nFree;
+        for (int i = 0; i < cache.nCurve; i++)
+        {
+            double x = xlo + (xhi - xlo) * i / (cache.nCurve - 1);
+            e.curveX.push_back(x);
+            e.curveY.push_back(f->EvalPar(&x, e.par.data()));
+        }
+        return e;
+    }
 
-                for (int i = 0; i < N; i++)
+    // chi2(T, beta) одной пары частица-центральность для Intervals и Contours: минимум по константе того же chi2, что минимизировал
+    // FitSpectrum, при тех же ограничениях константы, что у фита (ProfileChi2)
+    struct SpectrumProfile
+    {
+        shared_ptr<ROOT::Fit::BinData> data;
+        shared_ptr<CovarianceChi2> cov;                // useCovariance: chi2 с систематикой в ковариации
+        shared_ptr<BlastWaveChi2> lm;                  // leastSquares: невязки Левенберга-Марквардта
+        shared_ptr<ROOT::Math::WrappedMultiTF1> model;
+        shared_ptr<ROOT::Fit::Chi2Function> fcn;       // TGraph::Fit: chi2 по самому ifuncx
+        shared_ptr<double> c;      // константа в последнем минимуме - старт следующего
+        double cLo, cHi, mass;          // cLo == cHi - константа фиксирована
+
+        double operator()( double T, double beta ) const
+        {
+            double p[4] = {*c, T, beta, mass};
+            double chi2;
+            if (cov)
+            {
+                // C не зависит от параметров, а модель линейна по константе: выбеленные невязки
+                // z(c) = z(c0) + (c - c0) dz/dc, минимум по c (и на отрезке) - сразу
+                if (cLo < cHi)
                 {
-                    if (x[i] >= xmin[part] && x[i] <= xmax[part])
+                    int n = cov->Size();
+                    vector<double> z(n), jac(4 * n);
+                    cov->Residuals(p, z.data(), jac.data());
+                    double zg = 0, gg = 0;
+                    for (int i = 0; i < n; i++)
                     {
-                        d += pow((y[i] - ifuncx[part][centr]->Eval(x[i])) / y[i], 2);
-                        fitN++;
+                        zg += z[i] * jac[4 * i];
+                        gg += jac[4 * i] * jac[4 * i];
                     }
+                    if (gg > 0) p[0] = min(max(p[0] - zg / gg, cLo), cHi);
+                }
+                chi2 = (*cov)(p);
+            }
+            else if (lm && cLo < cHi)
+            {
+                // точный минимум без ограничений; вне границ chi2 на отрезке монотонен - минимум на краю
+                chi2 = lm->ProfileConstant(p);
+                if (p[0] < cLo || p[0] > cHi)
+                {
+                    p[0] = min(max(p[0], cLo), cHi);
+                    chi2 = (*lm)(p);
                 }
-                d = sqrt(d) / fitN;
+            }
+            else if (lm)
+                chi2 = (*lm)(p);
+            else
+                chi2 = MinimizeConstant(*fcn, p, cLo, cHi);
+            *c = p[0];
+            return chi2;
+        }
+    };
+
+    // Профиль ifuncx[part][centr] после FitSpectrum: с useCovariance - CovarianceChi2 на batch с эффективной
+    // дисперсией в точке фита (как после повторного Factorize в FitLeastSquares), с leastSquares - BlastWaveChi2,
+    // иначе - Chi2Function по самому TF1 (модель с gQuadrature или таблица useTables), т.е. chi2 TGraph::Fit.
+    // Константа фиксирована или в границах TF1, как в фите. TF1 общий для задач одной пары: EvalPar с явными
+    // параметрами его не меняет. ndf - точки chi2 без свободных параметров фита
+    SpectrumProfile ProfileChi2( int part, int centr, const BlastWaveBatch &batch, int &ndf ) const
+    {
+        TF1 *f = fCtx->ifuncx[part][centr];
+        SpectrumProfile profile;
+        ROOT::Fit::DataOptions opt;
+        ROOT::Fit::DataRange range(fCtx->xmin[part], fCtx->xmax[part]);
+        profile.data = make_shared<ROOT::Fit::BinData>(opt, range);
+        ROOT::Fit::FillData(*profile.data, fCtx->grSpectra[part][centr]);
+        ndf = (int)profile.data->Size() - f->GetNumberFreeParameters();
+
+        // как в TF1: lo >= hi (не оба нуля) - фиксирована, lo < hi - границы, иначе свободна
+        double lo, hi;
+        f->GetParLimits(0, lo, hi);
+        profile.c = make_shared<double>(f->GetParameter(0));
+        profile.cLo = -numeric_limits<double>::infinity();
+        profile.cHi = numeric_limits<double>::infinity();
+        if (lo * hi != 0 && lo >= hi) profile.cLo = profile.cHi = *profile.c;
+        else if (lo < hi)
+        {
+            profile.cLo = lo;
+            profile.cHi = hi;
+        }
+        profile.mass = f->GetParameter(3);
+
+        if (useCovariance)
+        {
+            profile.cov = make_shared<CovarianceChi2>(4, batch);
+            profile.cov->sysCorrelation = sysCorrelation;
+            profile.cov->AddSpecies(fCtx->grSpectra[part][centr], fCtx->spectraSys[part][centr],
+                                    fCtx->xmin[part], fCtx->xmax[part], profile.mass, 0, 1, 2);
+            profile.cov->Factorize(f->GetParameters());
+        }
+        else if (leastSquares)
+            profile.lm = make_shared<BlastWaveChi2>(*profile.data, batch);
+        else
+        {
+            profile.model = make_shared<ROOT::Math::WrappedMultiTF1>(*f, 1);
+            profile.fcn = make_shared<ROOT::Fit::Chi2Function>(*profile.data, *profile.model);
+        }
+        return profile;
+    }
+
+    // min chi2(p) по константе p[0] на [lo, hi] от старта p[0] (lo == hi - фиксирована), p[0] на выходе - минимум.
+    // Модель линейна по константе, и chi2 почти квадратичен по ней (от неё зависит только эффективная дисперсия),
+    // поэтому хватает нескольких шагов параболы по трём точкам
+    template <class F>
+    static double MinimizeConstant( const F &chi2, double *p, double lo, double hi )
+    {
+        double c = min(max(p[0], lo), hi);
+        p[0] = c;
+        double fc = chi2(p);
+        if (hi <= lo) return fc;
+
+        double h = 1.e-3 * fabs(c) + 1.e-12;
+        for (int iter = 0; iter < 30; iter++)
+        {
+            p[0] = c - h;
+            double fm = chi2(p);
+            p[0] = c + h;
+            double fp = chi2(p);
+            double d2 = fp - 2. * fc + fm;
+            // минимум параболы ниже текущего значения меньше чем на 1e-9 - сошлось
+            if (d2 > 0 && (fp - fm) * (fp - fm) < 8.e-9 * d2) break;
+            // вне области выпуклости - шаг 4h в сторону убывания
+            double cNew = (d2 > 0) ? c - 0.5 * h * (fp - fm) / d2 : c + ((fp < fm) ? 4. : -4.) * h;
+            cNew = min(max(cNew, lo), hi);
+            if (cNew == c) break;   // минимум на границе
+            p[0] = cNew;
+            double fNew = chi2(p);
+            if (fNew > fc)
+            {
+                // шаг параболы не уменьшил chi2 - меньший шаг разностей
+                h *= 0.1;
+                if (h < 1.e-10 * fabs(c)) break;
+                continue;
+            }
+            h = max(fabs(cNew - c), 1.e-6 * fabs(cNew));
+            c = cNew;
+            fc = fNew;
+        }
+        p[0] = c;
+        return fc;
+    }
 
-                cout << part << " " << centr << "  " << d << " " << chi2Ndf << endl;
+    // Старт и окна T, beta для ProfileInterval: параметры и ошибки Hesse ifuncx, окна - границы TF1 (как в TF1,
+    // lo >= hi не оба нуля - фиксирован) в физических окнах ContourScan, без границ - окна ContourScan
+    static void ProfileWindows( TF1 *f, double x0[2], double err0[2], double lo[2], double hi[2] )
+    {
+        const double physLo[2] = {0.02, 0.}, physHi[2] = {0.5, 0.95};
+        for (int i = 0; i < 2; i++)
+        {
+            x0[i] = f->GetParameter(i + 1);
+            err0[i] = f->GetParError(i + 1);
+            f->GetParLimits(i + 1, lo[i], hi[i]);
+            if (lo[i] * hi[i] != 0 && lo[i] >= hi[i]) lo[i] = hi[i] = x0[i];
+            else if (lo[i] < hi[i])
+            {
+                lo[i] = max(lo[i], physLo[i]);
+                hi[i] = min(hi[i], physHi[i]);
+            }
+            else
+            {
+                lo[i] = physLo[i];
+                hi[i] = physHi[i];
             }
         }
     }
+
+    // Единица подъёма chi2 профиля для Intervals и Contours: границы интервалов - chi2Min + up,
+    // контуры n сигм - chi2Min + up * ContourScan::DeltaChi2(n). up = chi2Min / NDF минимума профиля -
+    // та же нормировка, что у ошибок Hesse в outParamsErr, поэтому 1 сигма согласована у всех трёх;
+    // с useCovariance ошибки из ковариации не нормируются, и up = 1
+    double ProfileUp( double chi2Min, int ndf ) const
+    {
+        if (useCovariance) return 1.;
+        return (ndf > 0) ? chi2Min / ndf : 1.;
+    }
+
+    // Интервалы профильного правдоподобия (аналог MINOS) T и beta в outParamsInterval по chi2 фита (ProfileChi2):
+    // граница - подъём chi2 с профилированными константой и вторым параметром на ProfileUp над минимумом профиля.
+    // Окна - ProfileWindows, границы интервалов на краю окна - биты outIntervalLimit. Четыре границы каждой пары
+    // частица-центральность - отдельные задачи (профиль и его минимум у каждой свои, результат один)
+    void Intervals( const vector<pair<int, int>> &tasks )
+    {
+        auto ifuncx = fCtx->ifuncx;
+
+        for (const pair<int, int> &t: tasks) outIntervalLimit[t.first][t.second] = 0;
+        vector<char> atLimit(4 * tasks.size(), 0);
+
+        BlastWaveBatch batch;
+        TaskScheduler::Run(4 * tasks.size(), intervalThreads, [&](int k) {
+            int part = tasks[k / 4].first, centr = tasks[k / 4].second;
+            int par = (k % 4) / 2, side = (k % 2) ? 1 : -1;
+            int ndf;
+            SpectrumProfile profiled = ProfileChi2(part, centr, batch, ndf);
+            double x0[2], err0[2], lo[2], hi[2];
+            ProfileWindows(ifuncx[part][centr], x0, err0, lo, hi);
+
+            ProfileInterval interval(profiled, x0, err0, lo, hi);
+            double up = ProfileUp(interval.Minimize(), ndf);
+            bool limit;
+            outParamsInterval[part][centr][k % 4] = interval.Bound(par, side, up, &limit);
+            atLimit[k] = limit;
+        });
+
+        for (unsigned int k = 0; k < atLimit.size(); k++)
+            if (atLimit[k]) outIntervalLimit[tasks[k / 4].first][tasks[k / 4].second] |= 1 << (k % 4);
+    }
+
+    // Контуры chi2 фита (ProfileChi2) в (T, beta) для каждой пары частица-центральность в
+    // fCtx->contour[part][centr][1..nSigmaContour]: от минимума профиля, как у Intervals, уровни с тем же ProfileUp.
+    // Окно скана - минимум +- 4 ошибки Hesse с нормировкой sqrt(up), пары считаются параллельно в nThreads потоках
+    void Contours( const vector<pair<int, int>> &tasks )
+    {
+        auto ifuncx = fCtx->ifuncx;
+        auto contour = fCtx->contour;
+        int nSigma = min(nSigmaContour, N_SIGMA - 1);
+
+        BlastWaveBatch batch;
+        TaskScheduler::Run(tasks.size(), nThreads, [&](int i) {
+            int part = tasks[i].first, centr = tasks[i].second;
+            int ndf;
+            SpectrumProfile profiled = ProfileChi2(part, centr, batch, ndf);
+            double x0[2], err0[2], lo[2], hi[2];
+            ProfileWindows(ifuncx[part][centr], x0, err0, lo, hi);
+
+            ProfileInterval interval(profiled, x0, err0, lo, hi);
+            double chi2Min = interval.Minimize();
+            double up = ProfileUp(chi2Min, ndf);
+
+            double T = interval.X0(0), beta = interval.X0(1);
+            double dT = 4. * max(err0[0] * sqrt(up), 0.02 * T);
+            double dBeta = 4. * max(err0[1] * sqrt(up), 0.02 * beta);
+            ContourScan scan(profiled, max(0.02, T - dT), min(0.5, T + dT), max(0., beta - dBeta), min(0.95, beta + dBeta));
+            scan.nThreads = 1;
+            scan.up = up;
+            scan.Scan(chi2Min, nSigma);
+
+            for (int n = 1; n <= nSigma; n++)
+            {
+                delete contour[part][centr][n];
+                contour[part][centr][n] = scan.Contour(n);
+            }
+        });
+    }
 };
+
+
+#endif /* __BLASTWAVEFIT_H_ */
@@ -0,0 +1,251 @@
+#ifndef __BLASTWAVETABLE_H_
+#define __BLASTWAVETABLE_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <mutex>
+
+#include "def.h"
+
+
+// Таблица нормированного интеграла blastwave (constant = 1) для одной массы
+// на сетке (T, beta, mT - m). Хранится log интеграла, значение между узлами
+// восстанавливается кубической интерполяцией Лагранжа по каждой оси (4 x 4 x 4 узла).
+// Таблица пишется на диск и при следующих запусках отображается в память через mmap.
+struct BlastWaveTable
+{
+    // Заголовок файла таблицы
+    struct Header
+    {
+        char magic[8];              // "BWTABLE"
+        int version;
+        int nT, nB, nX;             // число узлов по T, beta, mT - m
+        int nodes;                  // число узлов квадратуры, которой считалась таблица
+        double mass;
+        double Tlo, Thi, Blo, Bhi, Xlo, Xhi;
+        double maxRelErr;           // проверенная точность интерполяции
+    };
+
+    Header fHeader;
+    const double *fData = 0;        // log интеграла, индекс ((iT * nB) + iB) * nX + iX
+    size_t fMapSize = 0;
+    void *fMap = 0;
+
+    ~BlastWaveTable()
+    {
+        if (fMap) munmap(fMap, fMapSize);
+    }
+
+    // Значение нормированного интеграла; вне диапазона таблицы - точный расчёт
+    double Eval( double T, double beta, double x ) const
+    {
+        const Header &h = fHeader;
+        double uT = (T - h.Tlo) / (h.Thi - h.Tlo) * (h.nT - 1);
+        double uB = (beta - h.Blo) / (h.Bhi - h.Blo) * (h.nB - 1);
+        double uX = (x - h.Xlo) / (h.Xhi - h.Xlo) * (h.nX - 1);
+
+        if (!fData || uT < 0 || uT > h.nT - 1 || uB < 0 || uB > h.nB - 1 || uX < 0 || uX > h.nX - 1)
+            return Exact(T, beta, x);
+
+        int iT, iB, iX;
+        double wT[4], wB[4], wX[4];
+        Stencil(uT, h.nT, iT, wT);
+        Stencil(uB, h.nB, iB, wB);
+        Stencil(uX, h.nX, iX, wX);
+
+        double logf = 0;
+        for (int a = 0; a < 4; a++)
+        {
+            for (int b = 0; b < 4; b++)
+            {
+                const double *row = fData + ((size_t)(iT + a) * h.nB + (iB + b)) * h.nX + iX;
+                double wAB = wT[a] * wB[b];
+                logf += wAB * (wX[0] * row[0] + wX[1] * row[1] + wX[2] * row[2] + wX[3] * row[3]);
+            }
+        }
+        return exp(logf);
+    }
+
+    // Точный интеграл одной точки (для проверки таблицы и вне её диапазона)
+    double Exact( double T, double beta, double x ) const
+    {
+        static const BlastWaveBatch batch(32);
+        double p[4] = {1., T, beta, fHeader.mass};
+        return batch.Value(x, p);
+    }
+
+    // Начальный узел и веса кубического Лагранжа по 4 узлам вокруг дробного индекса u
+    static void Stencil( double u, int n, int &i0, double w[4] )
+    {
+        i0 = (int)u - 1;
+        if (i0 < 0) i0 = 0;
+        if (i0 > n - 4) i0 = n - 4;
+
+        double t = u - i0;
+        w[0] = -(t - 1) * (t - 2) * (t - 3) / 6.;
+        w[1] =  t * (t - 2) * (t - 3) / 2.;
+        w[2] = -t * (t - 1) * (t - 3) / 2.;
+        w[3] =  t * (t - 1) * (t - 2) / 6.;
+    }
+
+    // Отобразить файл таблицы в память; false, если файла нет или он для другой массы / диапазонов
+    bool Map( const char *filename, double mass, const Header *expected = 0 )
+    {
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        fstat(fd, &st);
+        fMapSize = st.st_size;
+        fMap = (fMapSize >= sizeof(Header)) ? mmap(0, fMapSize, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (fMap == MAP_FAILED) { fMap = 0; return false; }
+
+        // сначала метка и версия (magic может быть без завершающего нуля), только потом размеры из заголовка
+        fHeader = *(const Header *)fMap;
+        bool ok = memcmp(fHeader.magic, "BWTABLE", sizeof(fHeader.magic)) == 0 && fHeader.version == 1
+               && fHeader.nT > 0 && fHeader.nB > 0 && fHeader.nX > 0;
+        size_t nData = ok ? (size_t)fHeader.nT * fHeader.nB * fHeader.nX : 0;
+        ok = ok && fabs(fHeader.mass - mass) < 1.e-9
+               && fMapSize == sizeof(Header) + nData * sizeof(double);
+        if (ok && expected)     // число узлов могло вырасти при построении, сверяем только диапазоны
+            ok = fHeader.Tlo == expected->Tlo && fHeader.Thi == expected->Thi
+              && fHeader.Blo == expected->Blo && fHeader.Bhi == expected->Bhi
+              && fHeader.Xlo == expected->Xlo && fHeader.Xhi == expected->Xhi;
+        if (!ok)
+        {
+            munmap(fMap, fMapSize);
+            fMap = 0;
+            return false;
+        }
+
+        fData = (const double *)((const char *)fMap + sizeof(Header));
+        return true;
+    }
+
+    // Построить таблицу, проверить её в центрах ячеек и записать в файл
+    // Сетка сгущается вдвое по всем осям, пока ошибка интерполяции не станет меньше relTol
+    static bool Build( const char *filename, Header h, double relTol )
+    {
+        BlastWaveBatch batch(h.nodes);
+
+        for (int pass = 0; pass < 3; pass++)
+        {
+            size_t nData = (size_t)h.nT * h.nB * h.nX;
+            vector<double> data(nData), x(h.nX), out(h.nX);
+            for (int iX = 0; iX < h.nX; iX++)
+                x[iX] = h.Xlo + (h.Xhi - h.Xlo) * iX / (h.nX - 1.);
+
+            // на каждое (T, beta) - один пакетный проход по всем mT
+            for (int iT = 0; iT < h.nT; iT++)
+            {
+                for (int iB = 0; iB < h.nB; iB++)
+                {
+                    double p[4] = {1., h.Tlo + (h.Thi - h.Tlo) * iT / (h.nT - 1.),
+                                   h.Blo + (h.Bhi - h.Blo) * iB / (h.nB - 1.), h.mass};
+                    batch.Evaluate(x.data(), h.nX, p, out.data());
+                    for (int iX = 0; iX < h.nX; iX++)
+                        data[((size_t)iT * h.nB + iB) * h.nX + iX] = log(out[iX]);
+                }
+            }
+
+            BlastWaveTable table;
+            table.fHeader = h;
+            table.fData = data.data();
+            h.maxRelErr = table.MaxRelError(batch);
+            cout << "BlastWaveTable mass = " << h.mass << ": " << h.nT << " x " << h.nB << " x " << h.nX
+                 << ", max rel. err. = " << h.maxRelErr << endl;
+
+            if (h.maxRelErr < relTol || pass == 2)
+            {
+                if (h.maxRelErr >= relTol)
+                    cout << "BlastWaveTable: WARNING tolerance " << relTol << " not reached" << endl;
+
+                table.fHeader = h;
+                ofstream f(filename, ios::binary);
+                f.write((const char *)&h, sizeof(Header));
+                f.write((const char *)data.data(), nData * sizeof(double));
+                return f.good();
+            }
+
+            h.nT = 2 * h.nT - 1;
+            h.nB = 2 * h.nB - 1;
+            h.nX = 2 * h.nX - 1;
+        }
+        return false;
+    }
+
+    // Наибольшая относительная ошибка интерполяции в центрах ячеек (там она максимальна)
+    double MaxRelError( const BlastWaveBatch &batch ) const
+    {
+        const Header &h = fHeader;
+        vector<double> x(h.nX - 1), out(h.nX - 1);
+        for (int iX = 0; iX < h.nX - 1; iX++)
+            x[iX] = h.Xlo + (h.Xhi - h.Xlo) * (iX + 0.5) / (h.nX - 1.);
+
+        double worst = 0;
+        for (int iT = 0; iT < h.nT - 1; iT++)
+        {
+            for (int iB = 0; iB < h.nB - 1; iB++)
+            {
+                double p[4] = {1., h.Tlo + (h.Thi - h.Tlo) * (iT + 0.5) / (h.nT - 1.),
+                               h.Blo + (h.Bhi - h.Blo) * (iB + 0.5) / (h.nB - 1.), h.mass};
+                batch.Evaluate(x.data(), h.nX - 1, p, out.data());
+                for (int iX = 0; iX < h.nX - 1; iX++)
+                    worst = max(worst, fabs(Eval(p[1], p[2], x[iX]) / out[iX] - 1.));
+            }
+        }
+        return worst;
+    }
+};
+
+
+// Таблица для частицы part: отображается из output/tables/, при отсутствии строится заново.
+// Диапазоны покрывают все фиты: T в [0.06, 0.25], beta в [0.1, 0.95], mT - m в [0, 2.5] ГэВ
+// (точки за пределами, например при отрисовке до больших pT, считаются точно)
+BlastWaveTable *GetBlastWaveTable( int part, double relTol = 1.e-3 )
+{
+    static BlastWaveTable *tables[MAX_PARTS] = {0};
+    static std::mutex tablesMutex;      // таблицы могут запрашиваться из нескольких AnalysisContext
+    std::lock_guard<std::mutex> lock(tablesMutex);
+    if (tables[part]) return tables[part];
+
+    BlastWaveTable::Header h = {"BWTABLE", 1, 40, 36, 51, 32, masses[part],
+                                0.06, 0.25, 0.1, 0.95, 0., 2.5, 0.};
+    string filename = "output/tables/BWtable_" + particles[part] + ".bin";
+
+    tables[part] = new BlastWaveTable();
+    tables[part]->fHeader = h;      // без таблицы Eval считает точно для этой массы
+    if (!tables[part]->Map(filename.c_str(), masses[part], &h))
+    {
+        mkdir("output/tables", 0755);
+        if (!BlastWaveTable::Build(filename.c_str(), h, relTol) || !tables[part]->Map(filename.c_str(), masses[part]))
+        {
+            cout << "BlastWaveTable: cannot build " << filename << ", using exact integral" << endl;
+            tables[part]->fHeader = h;
+        }
+    }
+    return tables[part];
+}
+
+
+// Функция для TF1 через таблицу: те же параметры, что у MyIntegFunc
+// p[0] = constant, p[1] = T, p[2] = beta, p[3] = mass (фиксирована таблицей)
+struct BlastWaveTableFunc
+{
+    BlastWaveTableFunc( const BlastWaveTable *table ):
+        fTable(table) {}
+
+    const BlastWaveTable *fTable;
+
+    double operator() ( double *x, double *p ) const
+    {
+        return p[0] * fTable->Eval(p[1], p[2], x[0]);
+    }
+};
+
+
+#endif /* __BLASTWAVETABLE_H_ */
@@ -0,0 +1,317 @@
+#ifndef __CONTOURSCAN_H_
+#define __CONTOURSCAN_H_
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "TGraph.h"
+#include "TMath.h"
+
+#include "TaskScheduler.h"
+
+
+// Поверхность chi2(T, beta) и контуры n сигм для двух параметров (chi2 = chi2Min + up * DeltaChi2(n), Level).
+// Сетка адаптивная: начальная nCoarse x nCoarse ячеек, ячейка делится на 4 (до depth раз), только если
+// значения в её углах или уже посчитанных точках на сторонах лежат по разные стороны какого-либо уровня.
+// Точки очередного прохода считаются параллельно в nThreads потоках (TaskScheduler, 0 - по числу ядер).
+// Контуры - marching squares по ячейкам наименьшего размера. Если уровень достигается на границе окна,
+// окно расширяется вдвое (в пределах T = [0.02, 0.5], beta = [0, 0.95]).
+// Точки контуров - (beta, T), как на рисунках контуров в BlastWaveFinal_all.C
+class ContourScan
+{
+public:
+    int nCoarse = 12;
+    int depth = 4;
+    int nThreads = 0;
+    double up = 1.;     // множитель приращений уровней (chi2/NDF фита, если ошибки нормируются на него)
+
+    ContourScan( const std::function<double(double, double)> &chi2, double T_lo, double T_hi, double beta_lo, double beta_hi ):
+        fChi2(chi2)
+    {
+        fLo[0] = T_lo;    fHi[0] = T_hi;
+        fLo[1] = beta_lo; fHi[1] = beta_hi;
+    }
+
+    // Приращение chi2 для уровня nSigma при двух параметрах: P(chi2_2 < d) = erf(nSigma / sqrt(2))
+    static double DeltaChi2( int nSigma )
+    {
+        return -2. * log(TMath::Erfc(nSigma / sqrt(2.)));
+    }
+
+    // Уровень контура nSigma над текущим минимумом
+    double Level( int nSigma ) const
+    {
+        return fMin + up * DeltaChi2(nSigma);
+    }
+
+    // Поверхность до уровней Level(1..nSigma); chi2Min - значение в минимуме фита
+    void Scan( double chi2Min, int nSigma )
+    {
+        fMin = chi2Min;
+        fNSigma = nSigma;
+        for (int attempt = 0; attempt < 4; attempt++)
+        {
+            Refine();
+
+            // минимум поверхности ниже минимума фита - уровни сдвигаются, посчитанные точки сохраняются
+            double vmin = fMin;
+            for (auto &v: fValues) vmin = std::min(vmin, v.second);
+            if (vmin < fMin - 1e-6)
+            {
+                fMin = vmin;
+                Refine();
+            }
+
+            if (!Expand()) break;
+        }
+    }
+
+    double Min() const { return fMin; }
+    int NEvaluations() const { return fNEval; }
+
+    // Линии уровня chi2 = level: точки (beta, T); замкнутые линии повторяют первую точку в конце
+    std::vector<std::vector<std::pair<double, double>>> Lines( double level ) const
+    {
+        std::vector<std::pair<long long, long long>> segments;
+        std::unordered_map<long long, std::pair<double, double>> points;
+
+        for (const auto &cell: fFinal)
+        {
+            int i = cell.first, j = cell.second;
+            double v[4] = {Value(i, j), Value(i + 1, j), Value(i + 1, j + 1), Value(i, j + 1)};
+            // стороны: 0 - (i,j)-(i+1,j), 1 - (i+1,j)-(i+1,j+1), 2 - (i,j+1)-(i+1,j+1), 3 - (i,j)-(i,j+1)
+            long long key[4] = {EdgeKey(i, j, 0), EdgeKey(i + 1, j, 1), EdgeKey(i, j + 1, 0), EdgeKey(i, j, 1)};
+            int ca[4] = {0, 1, 3, 0}, cb[4] = {1, 2, 2, 3};
+
+            std::vector<int> cut;
+            for (int e = 0; e < 4; e++)
+            {
+                double va = v[ca[e]], vb = v[cb[e]];
+                if ((va < level) == (vb < level)) continue;
+                cut.push_back(e);
+
+                double t = (level - va) / (vb - va);
+                int ia = i + (ca[e] == 1 || ca[e] == 2), ja = j + (ca[e] >= 2);
+                int ib = i + (cb[e] == 1 || cb[e] == 2), jb = j + (cb[e] >= 2);
+                double T = Coord(0, ia + t * (ib - ia)), beta = Coord(1, ja + t * (jb - ja));
+                points[key[e]] = std::make_pair(beta, T);
+            }
+
+            if (cut.size() == 2)
+                segments.push_back(std::make_pair(key[cut[0]], key[cut[1]]));
+            else if (cut.size() == 4)
+            {
+                // седловая ячейка: разделение по значению в центре
+                bool centerIn = 0.25 * (v[0] + v[1] + v[2] + v[3]) < level;
+                if (centerIn == (v[0] < level))
+                {
+                    segments.push_back(std::make_pair(key[0], key[1]));
+                    segments.push_back(std::make_pair(key[2], key[3]));
+                }
+                else
+                {
+                    segments.push_back(std::make_pair(key[3], key[0]));
+                    segments.push_back(std::make_pair(key[1], key[2]));
+                }
+            }
+        }
+
+        // сборка отрезков в линии по общим точкам на сторонах ячеек
+        std::unordered_map<long long, std::vector<int>> byPoint;
+        for (int s = 0; s < (int)segments.size(); s++)
+        {
+            byPoint[segments[s].first].push_back(s);
+            byPoint[segments[s].second].push_back(s);
+        }
+
+        std::vector<char> used(segments.size(), 0);
+        std::vector<std::vector<std::pair<double, double>>> lines;
+        for (int s0 = 0; s0 < (int)segments.size(); s0++)
+        {
+            if (used[s0]) continue;
+            used[s0] = 1;
+
+            std::vector<long long> chain = {segments[s0].first, segments[s0].second};
+            for (int dir = 0; dir < 2; dir++)
+            {
+                while (true)
+                {
+                    long long end = chain.back();
+                    int next = -1;
+                    for (int s: byPoint[end])
+                        if (!used[s]) { next = s; break; }
+                    if (next < 0) break;
+                    used[next] = 1;
+                    chain.push_back(segments[next].first == end ? segments[next].second : segments[next].first);
+                }
+                std::reverse(chain.begin(), chain.end());
+            }
+
+            std::vector<std::pair<double, double>> line;
+            for (long long k: chain) line.push_back(points[k]);
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    // Контур nSigma (самая длинная линия уровня); 0 - уровень не найден
+    TGraph *Contour( int nSigma ) const
+    {
+        std::vector<std::vector<std::pair<double, double>>> lines = Lines(Level(nSigma));
+        if (lines.empty()) return 0;
+
+        const std::vector<std::pair<double, double>> *longest = &lines[0];
+        for (const auto &line: lines)
+            if (line.size() > longest->size()) longest = &line;
+
+        TGraph *gr = new TGraph(longest->size());
+        for (int k = 0; k < (int)longest->size(); k++)
+            gr->SetPoint(k, (*longest)[k].first, (*longest)[k].second);
+        return gr;
+    }
+
+private:
+    std::function<double(double, double)> fChi2;
+    double fLo[2], fHi[2];
+    double fMin = 0;
+    int fNSigma = 3;
+    int fNEval = 0;
+
+    std::unordered_map<long long, double> fValues;      // значения в узлах мелкой решётки (i - T, j - beta)
+    std::vector<std::pair<int, int>> fFinal;            // ячейки наименьшего размера, пересекаемые уровнями
+
+    struct Cell { int i, j, size; };
+
+    int Size() const { return nCoarse << depth; }
+    long long Key( int i, int j ) const { return (long long)i * (Size() + 1) + j; }
+    long long EdgeKey( int i, int j, int dir ) const { return 2 * Key(i, j) + dir; }
+    double Coord( int axis, double index ) const { return fLo[axis] + (fHi[axis] - fLo[axis]) * index / Size(); }
+    double Value( int i, int j ) const { return fValues.at(Key(i, j)); }
+
+    // Пересекает ли какой-либо уровень ячейку (по углам и посчитанным точкам на сторонах)
+    bool Crossing( const Cell &c ) const
+    {
+        double vmin = 1e300, vmax = -1e300;
+        for (int k = 0; k < c.size; k++)
+        {
+            int node[4][2] = {{c.i + k, c.j}, {c.i + c.size, c.j + k}, {c.i + c.size - k, c.j + c.size}, {c.i, c.j + c.size - k}};
+            for (auto &p: node)
+            {
+                auto it = fValues.find(Key(p[0], p[1]));
+                if (it == fValues.end()) continue;
+                vmin = std::min(vmin, it->second);
+                vmax = std::max(vmax, it->second);
+            }
+        }
+        for (int n = 1; n <= fNSigma; n++)
+        {
+            double level = Level(n);
+            if (vmin < level && level <= vmax) return true;
+        }
+        return false;
+    }
+
+    // Значения в углах ячеек, которых ещё нет, - параллельно
+    void Evaluate( const std::vector<Cell> &cells )
+    {
+        std::vector<std::pair<int, int>> nodes;
+        std::map<long long, char> queued;
+        for (const Cell &c: cells)
+        {
+            int node[4][2] = {{c.i, c.j}, {c.i + c.size, c.j}, {c.i + c.size, c.j + c.size}, {c.i, c.j + c.size}};
+            for (auto &p: node)
+            {
+                long long key = Key(p[0], p[1]);
+                if (fValues.count(key) || queued.count(key)) continue;
+                queued[key] = 1;
+                nodes.push_back(std::make_pair(p[0], p[1]));
+            }
+        }
+
+        std::vector<double> values(nodes.size());
+        TaskScheduler::Run(nodes.size(), nThreads, [&](int k) {
+            values[k] = fChi2(Coord(0, nodes[k].first), Coord(1, nodes[k].second));
+            if (std::isnan(values[k])) values[k] = 1e30;
+        });
+        for (int k = 0; k < (int)nodes.size(); k++)
+            fValues[Key(nodes[k].first, nodes[k].second)] = values[k];
+        fNEval += nodes.size();
+    }
+
+    // Адаптивное сгущение сетки к уровням
+    void Refine()
+    {
+        int S = 1 << depth;
+        std::vector<Cell> pending, unsplit;
+        for (int i = 0; i < nCoarse; i++)
+            for (int j = 0; j < nCoarse; j++)
+                pending.push_back({i * S, j * S, S});
+        fFinal.clear();
+
+        while (true)
+        {
+            Evaluate(pending);
+
+            // ячейки, у которых новые точки на сторонах показали пересечение уровня
+            std::vector<Cell> rest;
+            for (const Cell &c: unsplit)
+                (Crossing(c) ? pending : rest).push_back(c);
+            unsplit.swap(rest);
+            if (pending.empty()) break;
+
+            std::vector<Cell> next;
+            for (const Cell &c: pending)
+            {
+                if (!Crossing(c)) unsplit.push_back(c);
+                else if (c.size == 1) fFinal.push_back(std::make_pair(c.i, c.j));
+                else
+                {
+                    int h = c.size / 2;
+                    next.push_back({c.i, c.j, h});
+                    next.push_back({c.i + h, c.j, h});
+                    next.push_back({c.i, c.j + h, h});
+                    next.push_back({c.i + h, c.j + h, h});
+                }
+            }
+            pending.swap(next);
+        }
+
+        std::sort(fFinal.begin(), fFinal.end());
+        fFinal.erase(std::unique(fFinal.begin(), fFinal.end()), fFinal.end());
+    }
+
+    // Расширение окна, если внешний уровень достигается на его границе; false - не нужно или некуда
+    bool Expand()
+    {
+        double level = Level(fNSigma);
+        int N = Size();
+        bool touch[2][2] = {{false, false}, {false, false}};
+        for (auto &v: fValues)
+        {
+            if (v.second >= level) continue;
+            int i = v.first / (N + 1), j = v.first % (N + 1);
+            if (i == 0) touch[0][0] = true;
+            if (i == N) touch[0][1] = true;
+            if (j == 0) touch[1][0] = true;
+            if (j == N) touch[1][1] = true;
+        }
+
+        const double limLo[2] = {0.02, 0.}, limHi[2] = {0.5, 0.95};
+        bool expanded = false;
+        for (int a = 0; a < 2; a++)
+        {
+            double w = fHi[a] - fLo[a];
+            if (touch[a][0] && fLo[a] > limLo[a]) { fLo[a] = std::max(limLo[a], fLo[a] - w); expanded = true; }
+            if (touch[a][1] && fHi[a] < limHi[a]) { fHi[a] = std::min(limHi[a], fHi[a] + w); expanded = true; }
+        }
+        if (expanded) fValues.clear();
+        return expanded;
+    }
+};
+
+
+#endif /* __CONTOURSCAN_H_ */
@@ -0,0 +1,310 @@
+#ifndef __COVARIANCECHI2_H_
+#define __COVARIANCECHI2_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "Fit/BinData.h"
+#include "Math/IFunction.h"
+#include "HFitInterface.h"
+#include "TGraphErrors.h"
+
+#include "def.h"
+#include "BlastWaveChi2.h"
+
+
+// chi2 с ковариацией точек спектра: chi2 = sum_s r_s^T C_s^{-1} r_s, r = y - f(p), где
+//     C_ij = e_i^2 delta_ij + s_i s_j (sysCorrelation + (1 - sysCorrelation) delta_ij),
+// e_i^2 = ey^2 + (ex df/dx)^2 - та же эффективная дисперсия, что у BlastWaveChi2, s_i - систематика s_s
+// (spectraSys, для AuAu её нет - остаётся только диагональ). sysCorrelation = 1 - систематика спектра
+// полностью скоррелирована (общая нормировка и форма), 0 - независима по точкам.
+// C не зависит от параметров: e_i^2 берётся в точке Factorize, разложение Холецкого C = L L^T считается
+// там же один раз и используется на всех итерациях минимизатора; после фита Factorize в найденной точке
+// и повторный фит уточняют эффективную дисперсию.
+// Параметры спектров отображаются на общие, как у GlobalChi2 (Add, AddSpecies), поэтому один класс
+// и для одного спектра (nPar = 4), и для глобального фита по частицам.
+// Треугольное решение L z = r идёт сразу для всех спектров: множители L хранятся с чередованием по спектрам
+// (элемент (i, j) всех спектров подряд), короткие спектры дополняются единичными строками, и внутренний
+// цикл по спектрам векторизуется (#pragma omp simd, как в BesselKernels.h).
+// Невязки Residuals - "выбеленные" z = L^{-1} r с якобианом, для LevenbergMarquardt и ResidualFunction
+class CovarianceChi2 : public ROOT::Math::IMultiGradFunction
+{
+public:
+    double sysCorrelation = 1.;
+
+    CovarianceChi2( int nPar, const BlastWaveBatch &batch, int nThreads = 1 ):
+        fNPar(nPar), fBatch(&batch), fExecutor(nThreads) {}
+
+    // Точки data и их систематика sys (по точке data) с отображением параметров map, value как в GlobalChi2::Add
+    void Add( const ROOT::Fit::BinData &data, const std::vector<double> &sys, const int map[4], const double value[4] )
+    {
+        Spectrum s;
+        for (unsigned int i = 0; i < data.Size(); i++)
+        {
+            s.x.push_back(data.Coords(i)[0]);
+            s.y.push_back(data.Value(i));
+            s.ey.push_back(data.Error(i));
+            s.ex.push_back(data.HaveCoordErrors() ? data.CoordErrors(i)[0] : 0.);
+            s.sys.push_back(sys[i]);
+        }
+        s.map = {map[0], map[1], map[2], map[3]};
+        s.value = {value[0], value[1], value[2], value[3]};
+        fSpectra.push_back(s);
+        fN = 0;                 // нужен новый Factorize
+        fL.clear();
+        fInvDiag.clear();
+    }
+
+    // Спектр gr в [xmin, xmax] с систематикой sys[i] точки gr i: своя константа par[parConst], общие T и beta
+    void AddSpecies( const TGraphErrors *gr, const double *sys, double xmin, double xmax, double mass,
+                     int parConst, int parT = 0, int parBeta = 1 )
+    {
+        ROOT::Fit::DataOptions opt;
+        ROOT::Fit::DataRange range(xmin, xmax);
+        ROOT::Fit::BinData data(opt, range);
+        ROOT::Fit::FillData(data, gr);
+
+        // систематика точек диапазона - по совпадению x с точкой графика (как в Toys)
+        std::vector<double> s;
+        for (unsigned int k = 0; k < data.Size(); k++)
+        {
+            int i = 0;
+            while (i < gr->GetN() && i < MAX_POINTS && gr->GetX()[i] != data.Coords(k)[0]) i++;
+            s.push_back((i < gr->GetN() && i < MAX_POINTS) ? sys[i] : 0.);
+        }
+
+        int map[4] = {parConst, parT, parBeta, -1};
+        double value[4] = {0., 0., 0., mass};
+        Add(data, s, map, value);
+    }
+
+    unsigned int NDim() const { return fNPar; }
+    unsigned int NTerms() const { return fSpectra.size(); }
+    ROOT::Math::IMultiGenFunction *Clone() const { return new CovarianceChi2(*this); }
+
+    unsigned int Size() const
+    {
+        unsigned int n = 0;
+        for (const Spectrum &s: fSpectra) n += s.x.size();
+        return n;
+    }
+
+    // Ковариации спектров с эффективной дисперсией в точке par и их разложения Холецкого (до первого вычисления chi2);
+    // false - какая-то C не положительно определена (точка без ошибок выпадает из chi2 и не мешает)
+    bool Factorize( const double *par )
+    {
+        int K = fSpectra.size();
+        fN = 0;
+        for (const Spectrum &s: fSpectra) fN = std::max(fN, (int)s.x.size());
+        fL.assign(fN * (fN + 1) / 2 * K, 0.);
+        fInvDiag.assign(fN * K, 1.);
+
+        std::vector<char> ok(K, 1);
+        fExecutor.Foreach(K, [&](unsigned int k) {
+            const Spectrum &s = fSpectra[k];
+            int n = s.x.size();
+            double p[4];
+            SetParams(par, k, p);
+            std::vector<double> f(n), df(n);
+            fBatch->Evaluate(s.x.data(), n, p, f.data(), df.data());
+
+            // C спектра и разложение на месте (нижний треугольник, строки подряд)
+            std::vector<double> a(n * (n + 1) / 2), diag(n);
+            for (int i = 0; i < n; i++)
+            {
+                double e2 = s.ey[i] * s.ey[i] + pow(s.ex[i] * df[i], 2);
+                for (int j = 0; j < i; j++) a[Tri(i, j)] = sysCorrelation * s.sys[i] * s.sys[j];
+                a[Tri(i, i)] = diag[i] = e2 + s.sys[i] * s.sys[i];
+            }
+            for (int i = 0; i < n; i++)
+            {
+                for (int j = 0; j <= i; j++)
+                {
+                    double v = a[Tri(i, j)];
+                    for (int l = 0; l < j; l++) v -= a[Tri(i, l)] * a[Tri(j, l)];
+                    if (i != j) a[Tri(i, j)] = (a[Tri(j, j)] > 0) ? v / a[Tri(j, j)] : 0.;
+                    else if (v > 0) a[Tri(i, i)] = sqrt(v);
+                    else
+                    {
+                        // строка исключается из chi2; ошибка, если у точки были ошибки
+                        a[Tri(i, i)] = 0;
+                        if (diag[i] > 0) ok[k] = 0;
+                    }
+                }
+            }
+            for (int i = 0; i < n; i++)
+            {
+                for (int j = 0; j <= i; j++) fL[Tri(i, j) * K + k] = a[Tri(i, j)];
+                fInvDiag[i * K + k] = (a[Tri(i, i)] > 0) ? 1. / a[Tri(i, i)] : 0.;
+            }
+            // дополнение до fN точек: единичные строки, невязки там нулевые
+            for (int i = n; i < fN; i++) fL[Tri(i, i) * K + k] = 1.;
+        });
+
+        for (char v: ok)
+            if (!v) return false;
+        return true;
+    }
+
+    // Разложение есть и соответствует текущему набору спектров
+    bool IsFactorized() const { return !fL.empty(); }
+
+    // Выбеленные невязки z = L^{-1} (y - f) всех спектров подряд и якобиан jac[i * NDim() + k] = dz_i / dpar_k;
+    // без Factorize - невязки kUnfactorized (chi2 огромный, минимизатор не примет такую точку)
+    void Residuals( const double *par, double *r, double *jac = 0 ) const
+    {
+        if (!CheckFactorized(r, jac)) return;
+        int K = fSpectra.size(), nc = jac ? 4 : 1;
+        std::vector<double> b;
+        Whiten(par, nc, b);
+
+        if (jac) std::fill(jac, jac + Size() * fNPar, 0.);
+        unsigned int offset = 0;
+        for (int k = 0; k < K; k++)
+        {
+            const Spectrum &s = fSpectra[k];
+            for (unsigned int i = 0; i < s.x.size(); i++, offset++)
+            {
+                r[offset] = b[(i * nc) * K + k];
+                if (!jac) continue;
+                for (int j = 0; j < 3; j++)
+                    if (s.map[j] >= 0) jac[offset * fNPar + s.map[j]] += b[(i * nc + 1 + j) * K + k];
+            }
+        }
+    }
+
+    void FdF( const double *par, double &chi2, double *grad ) const
+    {
+        if (!CheckFactorized())
+        {
+            chi2 = Size() * kUnfactorized * kUnfactorized;
+            for (unsigned int k = 0; k < fNPar; k++) grad[k] = 0;
+            return;
+        }
+        int K = fSpectra.size(), nc = 4;
+        std::vector<double> b;
+        Whiten(par, nc, b);
+
+        chi2 = 0;
+        for (unsigned int k = 0; k < fNPar; k++) grad[k] = 0;
+        for (int k = 0; k < K; k++)
+        {
+            const Spectrum &s = fSpectra[k];
+            for (unsigned int i = 0; i < s.x.size(); i++)
+            {
+                double z = b[(i * nc) * K + k];
+                chi2 += z * z;
+                for (int j = 0; j < 3; j++)
+                    if (s.map[j] >= 0) grad[s.map[j]] += 2. * z * b[(i * nc + 1 + j) * K + k];
+            }
+        }
+    }
+
+    void Gradient( const double *par, double *grad ) const
+    {
+        double chi2;
+        FdF(par, chi2, grad);
+    }
+
+private:
+    struct Spectrum
+    {
+        std::vector<double> x, y, ex, ey, sys;
+        std::array<int, 4> map;
+        std::array<double, 4> value;
+    };
+
+    unsigned int fNPar;
+    const BlastWaveBatch *fBatch;
+    std::vector<Spectrum> fSpectra;
+    TermExecutor fExecutor;
+    int fN = 0;                         // точек в самом длинном спектре
+    std::vector<double> fL;             // L (i, j <= i) всех спектров: fL[Tri(i, j) * K + k]
+    std::vector<double> fInvDiag;       // 1 / L (i, i): fInvDiag[i * K + k], 0 - строка исключена
+
+    static constexpr double kUnfactorized = 1.e10;
+
+    static int Tri( int i, int j ) { return i * (i + 1) / 2 + j; }
+
+    // true - разложение есть; иначе сообщение, r = kUnfactorized и нулевой якобиан (если r задан)
+    bool CheckFactorized( double *r = 0, double *jac = 0 ) const
+    {
+        if (IsFactorized()) return true;
+        std::cerr << "CovarianceChi2: Factorize() was not called after Add" << std::endl;
+        if (r) std::fill(r, r + Size(), kUnfactorized);
+        if (jac) std::fill(jac, jac + Size() * fNPar, 0.);
+        return false;
+    }
+
+    void SetParams( const double *par, int k, double *p ) const
+    {
+        for (int j = 0; j < 4; j++)
+            p[j] = (fSpectra[k].map[j] >= 0) ? par[fSpectra[k].map[j]] : fSpectra[k].value[j];
+    }
+
+    // b[(i * nc + c) * K + k]: столбец 0 - y - f, столбцы 1..3 (nc = 4) - -df/d(constant, T, beta);
+    // на выходе - L^{-1} b для всех спектров k одним проходом прямой подстановки
+    void Whiten( const double *par, int nc, std::vector<double> &b ) const
+    {
+        int K = fSpectra.size();
+        b.assign(fN * nc * K, 0.);
+
+        fExecutor.Foreach(K, [&](unsigned int k) {
+            const Spectrum &s = fSpectra[k];
+            int n = s.x.size();
+            double p[4];
+            SetParams(par, k, p);
+            std::vector<double> f(n), fx(n), fp(3 * n), fxp(3 * n);
+            if (nc == 1) fBatch->Evaluate(s.x.data(), n, p, f.data());
+            else fBatch->Gradient(s.x.data(), n, p, f.data(), fx.data(), fp.data(), fxp.data());
+            for (int i = 0; i < n; i++)
+            {
+                b[(i * nc) * K + k] = s.y[i] - f[i];
+                for (int j = 1; j < nc; j++) b[(i * nc + j) * K + k] = -fp[3 * i + j - 1];
+            }
+        });
+
+        for (int i = 0; i < fN; i++)
+        {
+            const double *Li = &fL[Tri(i, 0) * K];
+            const double *inv = &fInvDiag[i * K];
+            for (int c = 0; c < nc; c++)
+            {
+                double *bi = &b[(i * nc + c) * K];
+                for (int j = 0; j < i; j++)
+                {
+                    const double *Lij = Li + j * K;
+                    const double *bj = &b[(j * nc + c) * K];
+#pragma omp simd
+                    for (int k = 0; k < K; k++) bi[k] -= Lij[k] * bj[k];
+                }
+#pragma omp simd
+                for (int k = 0; k < K; k++) bi[k] *= inv[k];
+            }
+        }
+    }
+
+    double DoEval( const double *par ) const
+    {
+        if (!CheckFactorized()) return Size() * kUnfactorized * kUnfactorized;
+        int K = fSpectra.size();
+        std::vector<double> b;
+        Whiten(par, 1, b);
+        double chi2 = 0;
+        for (int k = 0; k < K; k++)
+            for (unsigned int i = 0; i < fSpectra[k].x.size(); i++) chi2 += b[i * K + k] * b[i * K + k];
+        return chi2;
+    }
+
+    double DoDerivative( const double *par, unsigned int icoord ) const
+    {
+        std::vector<double> grad(fNPar);
+        Gradient(par, grad.data());
+        return grad[icoord];
+    }
+};
+
+
+#endif /* __COVARIANCECHI2_H_ */
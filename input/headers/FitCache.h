@@ -0,0 +1,252 @@
+#ifndef __FITCACHE_H_
+#define __FITCACHE_H_
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "TF1.h"
+#include "TFitResult.h"
+#include "TGraphErrors.h"
+#include "TList.h"
+#include "Foption.h"
+#include "HFitInterface.h"
+#include "Math/MinimizerOptions.h"
+
+
+// Настройки минимизатора одного фита: тип и алгоритм задаются явно, остальное (точность, стратегия) -
+// значения ROOT по умолчанию. TMinuit (и пустой тип) заменяется на Minuit2: TMinuit - общий статический
+// объект, не потокобезопасен
+inline ROOT::Math::MinimizerOptions FitMinimizerOptions( std::string type, const std::string &algo = "" )
+{
+    if (type.empty() || type == "Minuit" || type == "TMinuit") type = "Minuit2";
+    ROOT::Math::MinimizerOptions options;
+    options.SetMinimizerType(type.c_str());
+    options.SetMinimizerAlgorithm(!algo.empty() ? algo.c_str() : (type == "Minuit2") ? "Migrad" : "");
+    return options;
+}
+
+// TGraph::Fit с минимизатором options: то же, что TGraph::Fit (FitOptionsMake и FitObject), но без
+// ROOT::Math::MinimizerOptions по умолчанию, которые общие для всего процесса. Поэтому фиты с разными
+// минимизаторами (несколько AnalysisContext) могут идти одновременно
+inline TFitResultPtr FitGraph( TGraph *gr, TF1 *f, const char *option, double xlo, double xhi,
+                               const ROOT::Math::MinimizerOptions &options )
+{
+    Foption_t fitOption;
+    ROOT::Fit::FitOptionsMake(ROOT::Fit::EFitObjectType::kGraph, option, fitOption);
+    ROOT::Fit::DataRange range(xlo, xhi);
+    return ROOT::Fit::FitObject(gr, f, fitOption, options, "", range);
+}
+
+
+// Результат фита в кэше: параметры, ошибки, ковариация, chi2 и кривая модели на диапазоне фита
+struct FitCacheEntry
+{
+    bool valid = false;
+    int nPar = 0;
+    std::vector<double> par, err, cov;     // cov - nPar x nPar по строкам
+    double chi2 = 0;
+    int ndf = 0, nPoints = 0;
+    std::vector<double> curveX, curveY;
+};
+
+
+// Кэш результатов фитов на диске, адресуемый содержимым: ключ - хэш (FNV-1a) точек графика,
+// идентификатора модели (функция, квадратура, таблица), диапазона, опций, стартовых значений, границ
+// и фиксированных параметров TF1 и минимизатора этого фита (тип, алгоритм, точность, стратегия, пределы
+// вызовов), а не глобального по умолчанию, который могут менять другие потоки. Одинаковый вход даёт тот же ключ, поэтому повторный фит
+// (перерисовка, повторная систематика) читает результат из dir/<ключ>.fit вместо минимизации.
+// Запись через временный файл и rename, поэтому кэш можно использовать из нескольких потоков и процессов.
+// version входит в ключ и увеличивается при каждом изменении кода модели (BlastWave.h, BlastWaveTable.h,
+// BlastWaveChi2.h): старые записи перестают совпадать
+class FitCache
+{
+public:
+    std::string dir = "output/cache";
+    std::string version = "2";  // 2 - kAdaptive в BlastWaveModel адаптивный, а не 32 узла
+    int nCurve = 100;           // точек кривой модели
+
+    // minOptions - минимизатор фита (0 - фит без минимизатора ROOT, например LevenbergMarquardt)
+    std::string Key( const TGraphErrors *gr, const TF1 *f, double xlo, double xhi,
+                     const std::string &option, const std::string &modelId,
+                     const ROOT::Math::MinimizerOptions *minOptions = 0 ) const
+    {
+        unsigned long long h = 14695981039346656037ULL;
+        HashText(version, h);
+        HashText(modelId, h);
+        HashText(option, h);
+        Hash(xlo, h);
+        Hash(xhi, h);
+        if (minOptions)
+        {
+            HashText(minOptions->MinimizerType(), h);
+            HashText(minOptions->MinimizerAlgorithm(), h);
+            Hash(minOptions->Tolerance(), h);
+            Hash(minOptions->Strategy(), h);
+            Hash(minOptions->Precision(), h);
+            Hash(minOptions->MaxFunctionCalls(), h);
+            Hash(minOptions->MaxIterations(), h);
+        }
+
+        for (int i = 0; i < gr->GetN(); i++)
+        {
+            Hash(gr->GetX()[i], h);
+            Hash(gr->GetY()[i], h);
+            Hash(gr->GetEX() ? gr->GetEX()[i] : 0., h);
+            Hash(gr->GetEY() ? gr->GetEY()[i] : 0., h);
+        }
+        for (int i = 0; i < f->GetNpar(); i++)
+        {
+            double lo, hi;
+            f->GetParLimits(i, lo, hi);
+            Hash(f->GetParameter(i), h);
+            Hash(lo, h);
+            Hash(hi, h);
+        }
+
+        char key[17];
+        snprintf(key, sizeof(key), "%016llx", h);
+        return key;
+    }
+
+    bool Load( const std::string &key, FitCacheEntry &e ) const
+    {
+        std::ifstream f(Path(key).c_str());
+        if (!f) return false;
+
+        int nCurvePoints;
+        f >> e.valid >> e.nPar >> e.chi2 >> e.ndf >> e.nPoints >> nCurvePoints;
+        if (!f || e.nPar < 0 || nCurvePoints < 0) return false;
+        e.par.resize(e.nPar);
+        e.err.resize(e.nPar);
+        e.cov.resize(e.nPar * e.nPar);
+        e.curveX.resize(nCurvePoints);
+        e.curveY.resize(nCurvePoints);
+        for (double &x: e.par) f >> x;
+        for (double &x: e.err) f >> x;
+        for (double &x: e.cov) f >> x;
+        for (int i = 0; i < nCurvePoints; i++) f >> e.curveX[i] >> e.curveY[i];
+        return !f.fail();
+    }
+
+    void Store( const std::string &key, const FitCacheEntry &e ) const
+    {
+        mkdir(dir.c_str(), 0755);
+        std::ostringstream tmpName;
+        tmpName << Path(key) << ".tmp" << getpid() << "_" << &e;
+
+        std::ofstream f(tmpName.str().c_str());
+        f.precision(17);
+        f << e.valid << " " << e.nPar << " " << e.chi2 << " " << e.ndf << " " << e.nPoints << " " << e.curveX.size() << "\n";
+        for (double x: e.par) f << x << " ";
+        f << "\n";
+        for (double x: e.err) f << x << " ";
+        f << "\n";
+        for (double x: e.cov) f << x << " ";
+        f << "\n";
+        for (unsigned int i = 0; i < e.curveX.size(); i++) f << e.curveX[i] << " " << e.curveY[i] << "\n";
+        f.close();
+        rename(tmpName.str().c_str(), Path(key).c_str());
+    }
+
+    // Запись по результату фита f (после TGraph::Fit с опцией S)
+    FitCacheEntry Entry( TF1 *f, const TFitResultPtr &result, double xlo, double xhi ) const
+    {
+        FitCacheEntry e;
+        e.valid = result->IsValid();
+        e.nPar = f->GetNpar();
+        e.par.assign(f->GetParameters(), f->GetParameters() + e.nPar);
+        e.err.assign(f->GetParErrors(), f->GetParErrors() + e.nPar);
+        e.cov.assign(e.nPar * e.nPar, 0.);
+        for (int i = 0; i < e.nPar; i++)
+            for (int j = 0; j < e.nPar; j++)
+                e.cov[i * e.nPar + j] = result->CovMatrix(i, j);
+        e.chi2 = f->GetChisquare();
+        e.ndf = f->GetNDF();
+        e.nPoints = f->GetNumberFitPoints();
+        for (int i = 0; i < nCurve; i++)
+        {
+            double x = xlo + (xhi - xlo) * i / (nCurve - 1);
+            e.curveX.push_back(x);
+            e.curveY.push_back(f->Eval(x));
+        }
+        return e;
+    }
+
+    // Параметры, ошибки и chi2 записи - в f, как после фита
+    static void Apply( const FitCacheEntry &e, TF1 *f )
+    {
+        f->SetParameters(e.par.data());
+        f->SetParErrors(e.err.data());
+        f->SetChisquare(e.chi2);
+        f->SetNDF(e.ndf);
+        f->SetNumberFitPoints(e.nPoints);
+    }
+
+    // f на графике gr, как после TGraph::Fit с опцией option: копия в списке функций gr (без N),
+    // без + - вместо прежних функций
+    static void Attach( TGraphErrors *gr, const TF1 *f, const std::string &option )
+    {
+        if (option.find('N') != std::string::npos) return;
+        TList *functions = gr->GetListOfFunctions();
+        if (option.find('+') == std::string::npos)
+            for (int i = functions->GetSize() - 1; i >= 0; i--)
+                if (functions->At(i)->InheritsFrom(TF1::Class())) delete functions->RemoveAt(i);
+        functions->Add(f->Clone());
+    }
+
+    // Фит gr функцией f с минимизатором minOptions (FitGraph) и кэшем; возвращает валидность результата,
+    // hit - взят ли результат из кэша
+    bool Fit( TGraphErrors *gr, TF1 *f, const char *option, double xlo, double xhi,
+              const std::string &modelId, const ROOT::Math::MinimizerOptions &minOptions, bool *hit = 0 ) const
+    {
+        std::string key = Key(gr, f, xlo, xhi, option, modelId, &minOptions);
+        FitCacheEntry e;
+        if (Load(key, e) && e.nPar == f->GetNpar())
+        {
+            Apply(e, f);
+            Attach(gr, f, option);
+            if (hit) *hit = true;
+            return e.valid;
+        }
+
+        std::string opt = std::string(option);
+        if (opt.find('S') == std::string::npos) opt += "S";
+        TFitResultPtr result = FitGraph(gr, f, opt.c_str(), xlo, xhi, minOptions);
+        if (hit) *hit = false;
+        if (!result.Get()) return false;
+
+        Store(key, Entry(f, result, xlo, xhi));
+        return result->IsValid();
+    }
+
+private:
+    std::string Path( const std::string &key ) const { return dir + "/" + key + ".fit"; }
+
+    static void HashText( const std::string &text, unsigned long long &h )
+    {
+        for (unsigned char c: text)
+        {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        h ^= 0xff;
+        h *= 1099511628211ULL;
+    }
+
+    static void Hash( double x, unsigned long long &h )
+    {
+        const unsigned char *b = reinterpret_cast<const unsigned char *>(&x);
+        for (unsigned int i = 0; i < sizeof(double); i++)
+        {
+            h ^= b[i];
+            h *= 1099511628211ULL;
+        }
+    }
+};
+
+
+#endif /* __FITCACHE_H_ */
@@ -0,0 +1,275 @@
+#ifndef __FITSETTINGS_H_
+#define __FITSETTINGS_H_
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "def.h"
+
+
+// Строка файла настроек: область (система, центральность, частица; -1 - любая) и значение ключа
+struct FitSetting
+{
+    int systN = -1, centr = -1, part = -1;
+    std::string key;
+    std::vector<std::string> values;
+    int line = 0;
+};
+
+
+// Копия стартовых значений handT, handBeta, handConst до FitSettings::ApplySeeds: Restore после фита
+// возвращает их, чтобы seed.* одного файла настроек не переходили в следующий фит (другую систему, файл)
+struct FitSeeds
+{
+    double T[N_CENTR], beta[N_CENTR], con[MAX_PARTS][MAX_CENTR];
+
+    void Save( const double *T0, const double *beta0, const double (*con0)[MAX_CENTR] )
+    {
+        std::copy(T0, T0 + N_CENTR, T);
+        std::copy(beta0, beta0 + N_CENTR, beta);
+        std::copy(&con0[0][0], &con0[0][0] + MAX_PARTS * MAX_CENTR, &con[0][0]);
+    }
+
+    void Restore( double *T0, double *beta0, double (*con0)[MAX_CENTR] ) const
+    {
+        std::copy(T, T + N_CENTR, T0);
+        std::copy(beta, beta + N_CENTR, beta0);
+        std::copy(&con[0][0], &con[0][0] + MAX_PARTS * MAX_CENTR, &con0[0][0]);
+    }
+};
+
+
+// Настройки фитов из текстового файла (по умолчанию input/config/fitSettings.txt) вместо
+// веток if (systN == ...) в макросах. Строка файла:
+//     <система> <центральность> <частица> <ключ> <значения...>
+// система - имя из systNamesT, центральность - индекс из CENTR_SYST, частица - имя из particles, * - любая.
+// Для каждого запроса действует последняя подходящая строка, поэтому общие строки пишутся раньше частных.
+// Ключи:
+//     final.const, final.T, final.beta  lo hi   - границы фита BlastWaveFit (кейс 0) в долях стартового значения
+//     global.T, global.beta             lo hi   - границы T и beta глобального фита (GlobalFitCentr);
+//                                                 строки с центральностью * - общее окно системы (SystemLimits)
+//     global.const                      lo hi   - границы констант глобального фита в долях handConst
+//     final.range, global.range         lo hi   - диапазон фита по mT - m (GeV)
+//     seed.const, seed.T, seed.beta     x       - стартовые значения вместо handConst, handT, handBeta
+//     final.minimizer, global.minimizer тип [алгоритм] - минимизатор (ROOT::Math::MinimizerOptions)
+// Вместо "lo hi" у границ можно указать fix - параметр фиксируется на стартовом значении.
+// Файл читается и проверяется один раз (Read), дальше настройки только запрашиваются, в том числе из нескольких потоков
+class FitSettings
+{
+public:
+    std::vector<FitSetting> settings;
+    bool valid = false;             // файл прочитан без ошибок
+
+    // false - файл не найден или есть ошибки (выводятся с номером строки)
+    bool Read( const std::string &filename )
+    {
+        settings.clear();
+        valid = false;
+        fFilename = filename;
+        std::ifstream f(filename.c_str());
+        if (!f)
+        {
+            std::cerr << "FitSettings: cannot open " << filename << std::endl;
+            return false;
+        }
+
+        bool ok = true;
+        std::string text;
+        for (int line = 1; std::getline(f, text); line++)
+        {
+            size_t comment = text.find('#');
+            if (comment != std::string::npos) text.erase(comment);
+
+            std::istringstream ss(text);
+            std::vector<std::string> tokens;
+            std::string token;
+            while (ss >> token) tokens.push_back(token);
+            if (tokens.empty()) continue;
+
+            FitSetting s;
+            s.line = line;
+            if (tokens.size() < 5)
+            {
+                ok = Error(line, "expected <system> <centr> <species> <key> <values>");
+                continue;
+            }
+            s.key = tokens[3];
+            s.values.assign(tokens.begin() + 4, tokens.end());
+            if (ParseScope(tokens, s) && Check(s)) settings.push_back(s);
+            else ok = false;
+        }
+        valid = ok;
+        return ok;
+    }
+
+    // Настройки по умолчанию: input/config/fitSettings.txt, читается один раз
+    static const FitSettings &Default()
+    {
+        static FitSettings settings = [] {
+            FitSettings s;
+            s.Read("input/config/fitSettings.txt");
+            return s;
+        }();
+        return settings;
+    }
+
+    // Последняя подходящая строка; centr, part = -1 - подходят только строки с * в этом поле
+    const FitSetting *Find( int systN, int centr, int part, const std::string &key ) const
+    {
+        const FitSetting *found = 0;
+        for (const FitSetting &s: settings)
+        {
+            if (s.key != key) continue;
+            if (s.systN >= 0 && s.systN != systN) continue;
+            if (s.centr >= 0 && s.centr != centr) continue;
+            if (s.part >= 0 && s.part != part) continue;
+            found = &s;
+        }
+        return found;
+    }
+
+    // Границы lo, hi; false - нет настройки или параметр фиксирован (fix = true)
+    bool Limits( int systN, int centr, int part, const std::string &key, double &lo, double &hi, bool *fix = 0 ) const
+    {
+        const FitSetting *s = Find(systN, centr, part, key);
+        if (fix) *fix = s && s->values[0] == "fix";
+        if (!s || s->values[0] == "fix") return false;
+        lo = atof(s->values[0].c_str());
+        hi = atof(s->values[1].c_str());
+        return true;
+    }
+
+    // Значение ключа с одним числом; def - если настройки нет
+    double Value( int systN, int centr, int part, const std::string &key, double def ) const
+    {
+        const FitSetting *s = Find(systN, centr, part, key);
+        return s ? atof(s->values[0].c_str()) : def;
+    }
+
+    // Минимизатор и алгоритм фита fit ("final" или "global"); false - не задан
+    bool Minimizer( int systN, const std::string &fit, std::string &type, std::string &algo ) const
+    {
+        const FitSetting *s = Find(systN, -1, -1, fit + ".minimizer");
+        if (!s) return false;
+        type = s->values[0];
+        algo = (s->values.size() > 1) ? s->values[1] : "";
+        return true;
+    }
+
+    // Стартовые значения seed.* системы systN в массивах handT, handBeta, handConst (контекста или def.h);
+    // массивы меняются на месте - прежние значения сохраняет и возвращает FitSeeds
+    void ApplySeeds( int systN, double *T0, double *beta0, double (*con0)[MAX_CENTR] ) const
+    {
+        for (int j = 0; j < N_CENTR_SYST[systN]; j++)
+        {
+            int centr = CENTR_SYST[systN][j];
+            T0[centr] = Value(systN, centr, -1, "seed.T", T0[centr]);
+            beta0[centr] = Value(systN, centr, -1, "seed.beta", beta0[centr]);
+            for (int part: PARTS)
+                con0[part][centr] = Value(systN, centr, part, "seed.const", con0[part][centr]);
+        }
+    }
+
+    // Диапазоны final.range системы systN в xmin, xmax по частицам
+    void ApplyRanges( int systN, double *xlo, double *xhi ) const
+    {
+        for (int part: PARTS)
+            Limits(systN, -1, part, "final.range", xlo[part], xhi[part]);
+    }
+
+private:
+    std::string fFilename;
+
+    bool Error( int line, const std::string &message ) const
+    {
+        std::cerr << "FitSettings: " << fFilename << ":" << line << ": " << message << std::endl;
+        return false;
+    }
+
+    bool ParseScope( const std::vector<std::string> &tokens, FitSetting &s ) const
+    {
+        if (tokens[0] != "*")
+        {
+            for (int i = 0; i < 5; i++)
+                if (tokens[0] == systNamesT[i].Data()) s.systN = i;
+            if (s.systN < 0) return Error(s.line, "unknown system " + tokens[0]);
+        }
+
+        if (tokens[1] != "*")
+        {
+            char *end;
+            s.centr = strtol(tokens[1].c_str(), &end, 10);
+            if (*end || s.centr < 0) return Error(s.line, "bad centrality " + tokens[1]);
+
+            // центральность должна быть в CENTR_SYST системы (или хотя бы одной системы для *)
+            bool known = false;
+            for (int syst = 0; syst < 5; syst++)
+            {
+                if (s.systN >= 0 && syst != s.systN) continue;
+                for (int j = 0; j < N_CENTR_SYST[syst]; j++)
+                    if (CENTR_SYST[syst][j] == s.centr) known = true;
+            }
+            if (!known) return Error(s.line, "centrality " + tokens[1] + " is not used by " + tokens[0]);
+        }
+
+        if (tokens[2] != "*")
+        {
+            for (int part: PARTS)
+                if (tokens[2] == particles[part]) s.part = part;
+            if (s.part < 0) return Error(s.line, "unknown species " + tokens[2]);
+        }
+        return true;
+    }
+
+    static bool IsNumber( const std::string &text )
+    {
+        char *end;
+        strtod(text.c_str(), &end);
+        return !text.empty() && *end == 0;
+    }
+
+    bool Check( const FitSetting &s ) const
+    {
+        const std::string limitKeys[] = {"final.const", "final.T", "final.beta", "global.T", "global.beta", "global.const",
+                                         "final.range", "global.range"};
+        const std::string valueKeys[] = {"seed.const", "seed.T", "seed.beta"};
+
+        for (const std::string &key: limitKeys)
+        {
+            if (s.key != key) continue;
+            bool isRange = (key == "final.range" || key == "global.range");
+            if (!isRange && s.values.size() == 1 && s.values[0] == "fix") return true;
+            if (s.values.size() != 2 || !IsNumber(s.values[0]) || !IsNumber(s.values[1]))
+                return Error(s.line, key + ": expected lo hi" + (isRange ? "" : " or fix"));
+            if (atof(s.values[0].c_str()) > atof(s.values[1].c_str()))
+                return Error(s.line, key + ": lo > hi");
+            if (key == "final.range" && s.centr >= 0)
+                return Error(s.line, key + ": the range is per system and species, centrality must be *");
+            return true;
+        }
+
+        for (const std::string &key: valueKeys)
+        {
+            if (s.key != key) continue;
+            if (s.values.size() != 1 || !IsNumber(s.values[0])) return Error(s.line, key + ": expected one number");
+            return true;
+        }
+
+        if (s.key == "final.minimizer" || s.key == "global.minimizer")
+        {
+            if (s.values.size() > 2) return Error(s.line, s.key + ": expected <type> [algorithm]");
+            if (s.centr >= 0 || s.part >= 0) return Error(s.line, s.key + ": centrality and species must be *");
+            return true;
+        }
+
+        return Error(s.line, "unknown key " + s.key);
+    }
+};
+
+
+#endif /* __FITSETTINGS_H_ */
@@ -0,0 +1,331 @@
+#ifndef __LEASTSQUARES_H_
+#define __LEASTSQUARES_H_
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include "RVersion.h"
+#include "Fit/FitConfig.h"
+#include "Math/FitMethodFunction.h"
+
+
+// Результат LevenbergMarquardt::Minimize
+struct LeastSquaresResult
+{
+    bool valid = false;
+    int nIter = 0, nEval = 0;       // итерации и вычисления невязок (с якобианом и без)
+    int nFree = 0;
+    double chi2 = 0;
+    std::vector<double> par, err;
+    std::vector<double> cov;        // nPar x nPar по строкам, у фиксированных параметров - нули
+
+    void Print( std::ostream &os ) const
+    {
+        os << "LevenbergMarquardt: " << (valid ? "converged" : "NOT converged")
+           << ", chi2 = " << chi2 << ", iterations = " << nIter << ", evaluations = " << nEval << std::endl;
+        for (unsigned int i = 0; i < par.size(); i++)
+            os << "  par " << i << " = " << par[i] << " +- " << err[i] << std::endl;
+    }
+};
+
+
+// Фит методом наименьших квадратов (Левенберг-Марквардт): chi2 = sum r_i^2, шаг - решение
+// (J^T J + lambda diag(J^T J)) d = -J^T r. Около минимума lambda -> 0 и метод переходит в Гаусс-Ньютон
+// с квадратичной сходимостью, поэтому вычислений модели нужно заметно меньше, чем Migrad по скалярному chi2.
+// Функция F - любой класс с NDim(), Size() и Residuals(par, r, jac) (BlastWaveChi2, GlobalChi2),
+// jac[i * NDim() + k] = dr_i / dpar_k. Границы - проекцией на [lo, hi]; параметр на границе, который
+// шаг выталкивает наружу, на этой итерации не меняется. Ковариация - (J^T J)^{-1} по свободным параметрам
+class LevenbergMarquardt
+{
+public:
+    int maxIter = 200;
+    double tolerance = 1.e-8;       // относительное изменение chi2 и параметров для остановки
+    double lambda0 = 1.e-3;
+
+    void SetParameters( int n, const double *par )
+    {
+        fPar.assign(par, par + n);
+        fLo.assign(n, -std::numeric_limits<double>::infinity());
+        fHi.assign(n, std::numeric_limits<double>::infinity());
+        fFixed.assign(n, false);
+    }
+
+    void SetLimits( int i, double lo, double hi )
+    {
+        fLo[i] = lo;
+        fHi[i] = hi;
+    }
+
+    void Fix( int i ) { fFixed[i] = true; }
+
+    // Новый старт без изменения границ и фиксированных параметров
+    void SetValues( const double *par ) { fPar.assign(par, par + fPar.size()); }
+
+    // Старт, границы и фиксированные параметры из конфигурации ROOT::Fit (как перед Fitter::FitFCN)
+    void Configure( const ROOT::Fit::FitConfig &config )
+    {
+        int n = config.NPar();
+        std::vector<double> par(n);
+        for (int i = 0; i < n; i++) par[i] = config.ParSettings(i).Value();
+        SetParameters(n, par.data());
+
+        for (int i = 0; i < n; i++)
+        {
+            const ROOT::Fit::ParameterSettings &s = config.ParSettings(i);
+            if (s.IsFixed()) Fix(i);
+            if (s.HasLowerLimit()) fLo[i] = s.LowerLimit();
+            if (s.HasUpperLimit()) fHi[i] = s.UpperLimit();
+        }
+    }
+
+    template <class F>
+    LeastSquaresResult Minimize( const F &f ) const
+    {
+        int n = f.Size(), m = fPar.size();
+        LeastSquaresResult res;
+        std::vector<double> x(fPar), r(n), J(n * m), rNew(n);
+        for (int k = 0; k < m; k++) x[k] = std::min(std::max(x[k], fLo[k]), fHi[k]);
+
+        f.Residuals(x.data(), r.data(), J.data());
+        res.nEval++;
+        double chi2 = Sum2(r);
+        double lambda = lambda0;
+        bool converged = false;
+
+        std::vector<double> A(m * m), g(m), d(m), xNew(m);
+        std::vector<int> free;
+        for (res.nIter = 0; res.nIter < maxIter && !converged; res.nIter++)
+        {
+            // J^T J и J^T r
+            std::fill(A.begin(), A.end(), 0.);
+            std::fill(g.begin(), g.end(), 0.);
+            for (int i = 0; i < n; i++)
+            {
+                const double *Ji = &J[i * m];
+                for (int k = 0; k < m; k++)
+                {
+                    if (Ji[k] == 0) continue;
+                    g[k] += Ji[k] * r[i];
+                    for (int l = 0; l <= k; l++) A[k * m + l] += Ji[k] * Ji[l];
+                }
+            }
+
+            // свободные на этой итерации: не фиксированы и не прижаты к границе направлением спуска
+            free.clear();
+            for (int k = 0; k < m; k++)
+            {
+                if (fFixed[k]) continue;
+                if (x[k] <= fLo[k] && g[k] > 0) continue;
+                if (x[k] >= fHi[k] && g[k] < 0) continue;
+                free.push_back(k);
+            }
+            if (free.empty()) break;
+
+            bool accepted = false;
+            while (!accepted && lambda < 1.e12)
+            {
+                if (!Solve(A, g, free, m, lambda, d))
+                {
+                    lambda *= 10;
+                    continue;
+                }
+
+                xNew = x;
+                for (int k: free) xNew[k] = std::min(std::max(x[k] + d[k], fLo[k]), fHi[k]);
+                f.Residuals(xNew.data(), rNew.data());
+                res.nEval++;
+                double chi2New = Sum2(rNew);
+
+                if (chi2New < chi2)
+                {
+                    accepted = true;
+                    double step = 0;
+                    for (int k: free) step = std::max(step, fabs(xNew[k] - x[k]) / (fabs(x[k]) + tolerance));
+                    converged = (chi2 - chi2New <= tolerance * (chi2 + tolerance)) || step <= tolerance;
+
+                    x = xNew;
+                    chi2 = chi2New;
+                    lambda = std::max(0.1 * lambda, 1.e-12);
+                    f.Residuals(x.data(), r.data(), J.data());
+                    res.nEval++;
+                }
+                else
+                    lambda *= 10;
+            }
+            // шаг не уменьшает chi2 ни при каком lambda - минимум с точностью вычислений
+            if (!accepted) converged = true;
+        }
+
+        res.par = x;
+        res.chi2 = chi2;
+        res.cov.assign(m * m, 0.);
+        res.err.assign(m, 0.);
+        res.valid = converged && Covariance(J, n, m, res);
+        return res;
+    }
+
+private:
+    std::vector<double> fPar, fLo, fHi;
+    std::vector<bool> fFixed;
+
+    static double Sum2( const std::vector<double> &r )
+    {
+        double s = 0;
+        for (double ri: r) s += ri * ri;
+        return s;
+    }
+
+    // Разложение Холецкого матрицы a (k x k, нижний треугольник); false - не положительно определена
+    static bool Cholesky( std::vector<double> &a, int k )
+    {
+        for (int i = 0; i < k; i++)
+        {
+            for (int j = 0; j <= i; j++)
+            {
+                double s = a[i * k + j];
+                for (int l = 0; l < j; l++) s -= a[i * k + l] * a[j * k + l];
+                if (i == j)
+                {
+                    if (s <= 0) return false;
+                    a[i * k + i] = sqrt(s);
+                }
+                else
+                    a[i * k + j] = s / a[j * k + j];
+            }
+        }
+        return true;
+    }
+
+    // (A + lambda diag A) d = -g по свободным параметрам
+    static bool Solve( const std::vector<double> &A, const std::vector<double> &g, const std::vector<int> &free,
+                       int m, double lambda, std::vector<double> &d )
+    {
+        int k = free.size();
+        std::vector<double> a(k * k, 0.), y(k);
+        for (int i = 0; i < k; i++)
+        {
+            for (int j = 0; j <= i; j++) a[i * k + j] = A[free[i] * m + free[j]];
+            a[i * k + i] *= 1. + lambda;
+            if (a[i * k + i] <= 0) a[i * k + i] = lambda;
+        }
+        if (!Cholesky(a, k)) return false;
+
+        for (int i = 0; i < k; i++)
+        {
+            double s = -g[free[i]];
+            for (int l = 0; l < i; l++) s -= a[i * k + l] * y[l];
+            y[i] = s / a[i * k + i];
+        }
+        for (int i = k - 1; i >= 0; i--)
+        {
+            double s = y[i];
+            for (int l = i + 1; l < k; l++) s -= a[l * k + i] * y[l];
+            y[i] = s / a[i * k + i];
+        }
+        std::fill(d.begin(), d.end(), 0.);
+        for (int i = 0; i < k; i++) d[free[i]] = y[i];
+        return true;
+    }
+
+    // (J^T J)^{-1} по нефиксированным параметрам
+    bool Covariance( const std::vector<double> &J, int n, int m, LeastSquaresResult &res ) const
+    {
+        std::vector<int> free;
+        for (int k = 0; k < m; k++)
+            if (!fFixed[k]) free.push_back(k);
+        int k = free.size();
+        res.nFree = k;
+
+        std::vector<double> a(k * k, 0.);
+        for (int i = 0; i < n; i++)
+            for (int p = 0; p < k; p++)
+                for (int q = 0; q <= p; q++)
+                    a[p * k + q] += J[i * m + free[p]] * J[i * m + free[q]];
+        if (!Cholesky(a, k)) return false;
+
+        // столбцы обратной матрицы: L L^T c = e_j
+        std::vector<double> c(k);
+        for (int j = 0; j < k; j++)
+        {
+            for (int i = 0; i < k; i++)
+            {
+                double s = (i == j) ? 1. : 0.;
+                for (int l = 0; l < i; l++) s -= a[i * k + l] * c[l];
+                c[i] = s / a[i * k + i];
+            }
+            for (int i = k - 1; i >= 0; i--)
+            {
+                double s = c[i];
+                for (int l = i + 1; l < k; l++) s -= a[l * k + i] * c[l];
+                c[i] = s / a[i * k + i];
+            }
+            for (int i = 0; i < k; i++) res.cov[free[i] * m + free[j]] = c[i];
+        }
+        for (int i = 0; i < k; i++) res.err[free[i]] = sqrt(res.cov[free[i] * m + free[i]]);
+        return true;
+    }
+};
+
+
+// Невязки F (BlastWaveChi2, GlobalChi2) как ROOT::Math::FitMethodFunction типа kLeastSquare:
+// для минимизаторов ROOT, работающих с невязками (Fumili2, GSLMultiFit), через Fitter::FitFCN(residuals).
+// DataElement вызывается по точкам, поэтому невязки и якобиан считаются один раз для набора параметров
+// и запоминаются; объект не для одновременного использования из нескольких потоков (у каждого фита свой)
+template <class F>
+class ResidualFunction : public ROOT::Math::FitMethodFunction
+{
+public:
+    explicit ResidualFunction( const F &f ):
+        ROOT::Math::FitMethodFunction(f.NDim(), f.Size()), fF(&f) {}
+
+    Type_t Type() const { return kLeastSquare; }
+    ROOT::Math::IMultiGenFunction *Clone() const { return new ResidualFunction(*fF); }
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 24, 0)
+    double DataElement( const double *x, unsigned int i, double *g = nullptr, double *h = nullptr,
+                        bool fullHessian = false ) const
+    {
+        (void)h;
+        (void)fullHessian;
+        return Element(x, i, g);
+    }
+#else
+    double DataElement( const double *x, unsigned int i, double *g = 0 ) const
+    {
+        return Element(x, i, g);
+    }
+#endif
+
+private:
+    const F *fF;
+    mutable std::vector<double> fX, fR, fJ;
+
+    double Element( const double *x, unsigned int i, double *g ) const
+    {
+        unsigned int m = NDim();
+        if (fX.size() != m || !std::equal(fX.begin(), fX.end(), x))
+        {
+            fX.assign(x, x + m);
+            fR.resize(NPoints());
+            fJ.resize(NPoints() * m);
+            fF->Residuals(x, fR.data(), fJ.data());
+        }
+        if (g) std::copy(&fJ[i * m], &fJ[i * m] + m, g);
+        return fR[i];
+    }
+
+    double DoEval( const double *x ) const
+    {
+        this->UpdateNCalls();
+        std::vector<double> r(NPoints());
+        fF->Residuals(x, r.data());
+        double chi2 = 0;
+        for (double ri: r) chi2 += ri * ri;
+        return chi2;
+    }
+};
+
+
+#endif /* __LEASTSQUARES_H_ */
@@ -0,0 +1,34 @@
+// Словарь libBlastWave (CMakeLists.txt): модель, chi2 и вспомогательные классы,
+// не зависящие от глобальных массивов def.h
+#ifdef __CLING__
+
+#pragma link off all globals;
+#pragma link off all classes;
+#pragma link off all functions;
+
+#pragma link C++ enum EQuadrature;
+#pragma link C++ global gQuadrature;
+#pragma link C++ function bwfitfunc;
+#pragma link C++ function GaussLegendreNodes;
+#pragma link C++ function QuadratureDeviation;
+
+#pragma link C++ class GaussLegendreRule<16>-;
+#pragma link C++ class GaussLegendreRule<32>-;
+#pragma link C++ class GaussLegendreRule<64>-;
+#pragma link C++ class MyIntegFunc-;
+#pragma link C++ class BlastWaveBatch-;
+#pragma link C++ class BlastWaveModel-;
+
+#pragma link C++ class BlastWaveChi2-;
+#pragma link C++ class ProfiledChi2-;
+#pragma link C++ class CentralityChi2-;
+#pragma link C++ class GlobalChi2-;
+
+#pragma link C++ class ContourScan-;
+#pragma link C++ class LocalMinimum-;
+#pragma link C++ class MultiStart-;
+#pragma link C++ class FitCacheEntry-;
+#pragma link C++ class FitCache-;
+#pragma link C++ class TaskScheduler-;
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef __MULTISTART_H_
+#define __MULTISTART_H_
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "TRandom3.h"
+#include "TROOT.h"
+#include "Fit/Fitter.h"
+#include "Fit/FitConfig.h"
+#include "Math/IFunction.h"
+
+#include "TaskScheduler.h"
+
+
+// Локальный минимум, найденный мультистартом
+struct LocalMinimum
+{
+    std::vector<double> par, err, cov;  // cov - n x n по строкам
+    double chi2;
+    int nHits;              // число стартов, сошедшихся в этот минимум
+};
+
+
+// Мультистарт вместо глобальных минимизаторов (GSLSimAn, Genetic): nStarts стартовых точек (T, beta)
+// по латинскому гиперкубу в окне [T_min, T_max] x [beta_min, beta_max], из каждой - отдельный фит
+// с настройками config (минимизатор, старт и границы остальных параметров), параллельно в nThreads
+// потоках (TaskScheduler, 0 - по числу ядер). Границы T и beta - само окно, без подобранных вручную.
+// Сошедшиеся фиты объединяются в различные минимумы: совпадающими считаются точки, у которых
+// T и beta отличаются меньше чем на tol от ширины окна. Минимумы отсортированы по chi2.
+class MultiStart
+{
+public:
+    int iT = 0, iBeta = 1;          // индексы T и beta среди параметров функции
+    int nStarts = 16;
+    int nThreads = 0;
+    double tol = 1e-3;
+    unsigned int seed = 4357;
+
+    MultiStart( double T_min, double T_max, double beta_min, double beta_max )
+    {
+        fMin[0] = T_min;    fMax[0] = T_max;
+        fMin[1] = beta_min; fMax[1] = beta_max;
+    }
+
+    std::vector<LocalMinimum> Run( const ROOT::Math::IMultiGradFunction &f, const ROOT::Fit::FitConfig &config,
+                                   unsigned int dataSize ) const
+    {
+        std::vector<double> T0, beta0;
+        LatinHypercube(nStarts, T0, beta0);
+
+        if (nThreads != 1) ROOT::EnableThreadSafety();
+
+        std::vector<LocalMinimum> found(nStarts);
+        std::vector<char> valid(nStarts, 0);
+        TaskScheduler::Run(nStarts, nThreads, [&](int i) {
+            ROOT::Fit::Fitter fitter;
+            fitter.Config() = config;
+            fitter.Config().ParSettings(iT).SetValue(T0[i]);
+            fitter.Config().ParSettings(iT).SetLimits(fMin[0], fMax[0]);
+            fitter.Config().ParSettings(iBeta).SetValue(beta0[i]);
+            fitter.Config().ParSettings(iBeta).SetLimits(fMin[1], fMax[1]);
+            if (!fitter.FitFCN(f, 0, dataSize, true)) return;
+
+            const ROOT::Fit::FitResult &result = fitter.Result();
+            if (!result.IsValid()) return;
+
+            int n = f.NDim();
+            found[i].par.assign(result.GetParams(), result.GetParams() + n);
+            found[i].err.assign(result.GetErrors(), result.GetErrors() + n);
+            found[i].cov.resize(n * n);
+            for (int k = 0; k < n; k++)
+                for (int l = 0; l < n; l++)
+                    found[i].cov[k * n + l] = result.CovMatrix(k, l);
+            found[i].chi2 = result.MinFcnValue();
+            found[i].nHits = 1;
+            valid[i] = 1;
+        });
+
+        std::vector<LocalMinimum> minima;
+        for (int i = 0; i < nStarts; i++)
+            if (valid[i]) minima.push_back(found[i]);
+        return Distinct(minima);
+    }
+
+    // Стартовые точки: по одной в каждом из n интервалов по T и по beta, интервалы beta перемешаны
+    void LatinHypercube( int n, std::vector<double> &T0, std::vector<double> &beta0 ) const
+    {
+        TRandom3 rnd(seed);
+        std::vector<int> perm(n);
+        for (int i = 0; i < n; i++) perm[i] = i;
+        for (int i = n - 1; i > 0; i--) std::swap(perm[i], perm[rnd.Integer(i + 1)]);
+
+        T0.resize(n);
+        beta0.resize(n);
+        for (int i = 0; i < n; i++)
+        {
+            T0[i] = fMin[0] + (fMax[0] - fMin[0]) * (i + rnd.Rndm()) / n;
+            beta0[i] = fMin[1] + (fMax[1] - fMin[1]) * (perm[i] + rnd.Rndm()) / n;
+        }
+    }
+
+    // Объединение совпадающих минимумов; от каждой группы остаётся лучший по chi2
+    std::vector<LocalMinimum> Distinct( std::vector<LocalMinimum> minima ) const
+    {
+        std::sort(minima.begin(), minima.end(),
+                  [](const LocalMinimum &a, const LocalMinimum &b) { return a.chi2 < b.chi2; });
+
+        std::vector<LocalMinimum> distinct;
+        for (const LocalMinimum &m: minima)
+        {
+            bool same = false;
+            for (LocalMinimum &d: distinct)
+            {
+                if (fabs(m.par[iT] - d.par[iT]) < tol * (fMax[0] - fMin[0]) &&
+                    fabs(m.par[iBeta] - d.par[iBeta]) < tol * (fMax[1] - fMin[1]))
+                {
+                    d.nHits += m.nHits;
+                    same = true;
+                    break;
+                }
+            }
+            if (!same) distinct.push_back(m);
+        }
+        return distinct;
+    }
+
+    void Print( const std::vector<LocalMinimum> &minima ) const
+    {
+        std::cout << "MultiStart: " << minima.size() << " distinct minima from " << nStarts << " starts" << std::endl;
+        for (unsigned int k = 0; k < minima.size(); k++)
+        {
+            const LocalMinimum &m = minima[k];
+            std::cout << "  " << k << ": chi2 = " << m.chi2
+                      << ", T = " << m.par[iT] << " +- " << m.err[iT]
+                      << ", beta = " << m.par[iBeta] << " +- " << m.err[iBeta]
+                      << " (" << m.nHits << " starts)" << std::endl;
+        }
+    }
+
+private:
+    double fMin[2], fMax[2];
+};
+
+
+#endif /* __MULTISTART_H_ */
@@ -0,0 +1,265 @@
+#ifndef __PIPELINE_H_
+#define __PIPELINE_H_
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "TaskScheduler.h"
+
+
+// Этап цепочки анализа: макрос ROOT с вызовом (например, "systN = 3; BlastWaveGlobal_all()"),
+// входные файлы (данные, заголовки, выходы предыдущих этапов) и выходные файлы
+struct Stage
+{
+    std::string name;
+    std::string macro;                  // файл макроса (тоже входной)
+    std::string call;                   // вызов после загрузки макроса - часть конфигурации
+    std::vector<std::string> inputs, outputs;
+    std::vector<std::string> deps;      // имена этапов, которые должны выполниться раньше
+};
+
+
+// Инкрементальный запуск цепочки макросов: этапы - вершины DAG, ключ этапа - хэш (FNV-1a) содержимого
+// макроса, входных файлов и строки вызова. Этап перезапускается, только если ключ отличается от сохранённого
+// в stampDir/<name>.hash или нет какого-либо выходного файла. Выходы предыдущих этапов - входы следующих,
+// поэтому этап ниже по цепочке перезапускается, только если содержимое этих файлов действительно изменилось.
+// Каждый этап - отдельный процесс root -b -q (макросы используют глобальные массивы и systN из def.h),
+// этапы одного уровня DAG (например, разные системы) идут параллельно в nThreads потоках (0 - по числу ядер).
+// Этапы после упавшего не запускаются
+class Pipeline
+{
+public:
+    int nThreads = 0;
+    bool dryRun = false;                // только список устаревших этапов
+    std::string stampDir = "output/pipeline";
+    std::string root = "root -l -b -q";
+
+    void Add( const Stage &stage ) { fStages.push_back(stage); }
+
+    // Все файлы каталога dir с окончанием suffix (например, все заголовки input/headers)
+    static std::vector<std::string> Files( const std::string &dir, const std::string &suffix )
+    {
+        std::vector<std::string> files;
+        DIR *d = opendir(dir.c_str());
+        if (!d) return files;
+        while (dirent *e = readdir(d))
+        {
+            std::string name = e->d_name;
+            if (name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+                files.push_back(dir + "/" + name);
+        }
+        closedir(d);
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    // false - какой-либо этап упал
+    bool Run()
+    {
+        mkdir(stampDir.c_str(), 0755);
+
+        std::vector<int> level = Levels();
+        if (level.size() != fStages.size()) return false;
+        int nLevels = 0;
+        for (int l: level) nLevels = std::max(nLevels, l + 1);
+
+        int n = fStages.size();
+        std::vector<char> failed(n, 0);
+        for (int l = 0; l < nLevels; l++)
+        {
+            std::vector<int> stages;
+            for (int i = 0; i < n; i++)
+                if (level[i] == l) stages.push_back(i);
+
+            std::vector<std::string> logs(stages.size());
+            TaskScheduler::Run(stages.size(), nThreads, [&](int k) {
+                int i = stages[k];
+                const Stage &s = fStages[i];
+                std::ostringstream log;
+
+                for (const std::string &dep: s.deps)
+                    if (failed[Index(dep)]) failed[i] = 1;
+                if (failed[i])
+                {
+                    log << "Pipeline: " << s.name << " skipped (dependency failed)" << std::endl;
+                    logs[k] = log.str();
+                    return;
+                }
+
+                std::string key = Key(s);
+                if (key == ReadStamp(s.name) && OutputsExist(s))
+                {
+                    log << "Pipeline: " << s.name << " up to date" << std::endl;
+                    logs[k] = log.str();
+                    return;
+                }
+
+                log << "Pipeline: " << s.name << (dryRun ? " out of date" : " running") << std::endl;
+                if (!dryRun)
+                {
+                    if (Execute(s) == 0 && OutputsExist(s)) WriteStamp(s.name, key);
+                    else
+                    {
+                        failed[i] = 1;
+                        log << "Pipeline: " << s.name << " FAILED" << std::endl;
+                    }
+                }
+                logs[k] = log.str();
+            });
+            for (const std::string &log: logs) std::cout << log;
+        }
+
+        for (char f: failed)
+            if (f) return false;
+        return true;
+    }
+
+private:
+    std::vector<Stage> fStages;
+
+    // -1 - нет такого этапа
+    int Index( const std::string &name ) const
+    {
+        for (int i = 0; i < (int)fStages.size(); i++)
+            if (fStages[i].name == name) return i;
+        return -1;
+    }
+
+    // Уровень этапа - длина самой длинной цепочки зависимостей до него; пусто - неизвестная зависимость или цикл
+    std::vector<int> Levels() const
+    {
+        for (const Stage &s: fStages)
+            for (const std::string &dep: s.deps)
+                if (Index(dep) < 0)
+                {
+                    std::cerr << "Pipeline: unknown stage " << dep << " in " << s.name << std::endl;
+                    return std::vector<int>();
+                }
+
+        int n = fStages.size();
+        std::vector<int> level(n, -1);
+        for (int pass = 0; pass < n; pass++)
+        {
+            bool changed = false;
+            for (int i = 0; i < n; i++)
+            {
+                int l = 0;
+                bool ready = true;
+                for (const std::string &dep: fStages[i].deps)
+                {
+                    int d = Index(dep);
+                    if (level[d] < 0) { ready = false; break; }
+                    l = std::max(l, level[d] + 1);
+                }
+                if (ready && level[i] != l) { level[i] = l; changed = true; }
+            }
+            if (!changed) break;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (level[i] < 0)
+            {
+                std::cerr << "Pipeline: dependency cycle at " << fStages[i].name << std::endl;
+                return std::vector<int>();
+            }
+        }
+        return level;
+    }
+
+    // FNV-1a по содержимому файла; отсутствующий файл даёт свой хэш
+    static void HashFile( const std::string &file, unsigned long long &h )
+    {
+        std::ifstream f(file.c_str(), std::ios::binary);
+        if (!f)
+        {
+            HashText("<missing>" + file, h);
+            return;
+        }
+        char buf[65536];
+        while (f.read(buf, sizeof(buf)) || f.gcount() > 0)
+        {
+            for (std::streamsize i = 0; i < f.gcount(); i++)
+            {
+                h ^= (unsigned char)buf[i];
+                h *= 1099511628211ULL;
+            }
+        }
+    }
+
+    // FNV-1a по строке и разделителю (чтобы "ab" + "c" и "a" + "bc" различались)
+    static void HashText( const std::string &text, unsigned long long &h )
+    {
+        for (unsigned char c: text)
+        {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        h ^= 0xff;
+        h *= 1099511628211ULL;
+    }
+
+    std::string Key( const Stage &s ) const
+    {
+        unsigned long long h = 14695981039346656037ULL;
+        HashText(s.call, h);
+        HashFile(s.macro, h);
+        for (const std::string &file: s.inputs)
+        {
+            HashText(file, h);
+            HashFile(file, h);
+        }
+        char key[17];
+        snprintf(key, sizeof(key), "%016llx", h);
+        return key;
+    }
+
+    std::string ReadStamp( const std::string &name ) const
+    {
+        std::ifstream f((stampDir + "/" + name + ".hash").c_str());
+        std::string key;
+        f >> key;
+        return key;
+    }
+
+    void WriteStamp( const std::string &name, const std::string &key ) const
+    {
+        std::ofstream f((stampDir + "/" + name + ".hash").c_str());
+        f << key << std::endl;
+    }
+
+    static bool OutputsExist( const Stage &s )
+    {
+        struct stat st;
+        for (const std::string &file: s.outputs)
+            if (stat(file.c_str(), &st) != 0) return false;
+        return true;
+    }
+
+    // Макрос-обёртка stampDir/<name>.C: загружает макрос этапа и выполняет call; вывод - в stampDir/<name>.log
+    int Execute( const Stage &s ) const
+    {
+        std::string wrapper = stampDir + "/" + s.name + ".C";
+        std::string up = "../";
+        for (char c: stampDir)
+            if (c == '/') up += "../";
+
+        std::ofstream f(wrapper.c_str());
+        f << "#include \"" << up << s.macro << "\"\n\n"
+          << "void " << s.name << "() { " << s.call << "; }\n";
+        f.close();
+
+        std::string cmd = root + " " + wrapper + " > " + stampDir + "/" + s.name + ".log 2>&1";
+        return system(cmd.c_str());
+    }
+};
+
+
+#endif /* __PIPELINE_H_ */
@@ -0,0 +1,198 @@
+#ifndef __PROFILEINTERVAL_H_
+#define __PROFILEINTERVAL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+
+// Интервал профильного правдоподобия (аналог MINOS) для T или beta по chi2(T, beta) с уже профилированной
+// константой (BlastWaveChi2::ProfileConstant): граница - точка, где min chi2 по второму параметру
+// поднимается на up над минимумом профиля. Минимум (Minimize) ищется заново, как у ContourScan: минимум фита
+// по другой модели интеграла или с неточной сходимостью сдвигал бы уровень границ. Нижняя и верхняя
+// границы каждого параметра независимы (Bound), поэтому их можно считать в отдельных задачах TaskScheduler.
+// Второй параметр минимизируется золотым сечением в окне около предыдущего минимума (шаг за шагом от
+// минимума), граница - регула фальси по разности chi2 - chi2Min - up.
+// Окна параметров - границы фита (lo, hi); граница интервала, упёршаяся в край окна, отмечается atLimit
+class ProfileInterval
+{
+public:
+    double tolerance = 1.e-4;   // точность границы в долях начального шага
+    int maxSteps = 30;          // шагов поиска интервала, содержащего границу
+
+    // chi2(T, beta), минимум фита (T, beta) = (x0[0], x0[1]) с ошибками Hesse err0, окна T = [lo[0], hi[0]],
+    // beta = [lo[1], hi[1]] (lo == hi - параметр фиксирован)
+    ProfileInterval( const std::function<double(double, double)> &chi2, const double x0[2], const double err0[2],
+                     const double lo[2], const double hi[2] ):
+        fChi2(chi2)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            fLo[k] = lo[k];
+            fHi[k] = std::max(lo[k], hi[k]);
+            fX0[k] = std::min(std::max(x0[k], fLo[k]), fHi[k]);
+            fErr0[k] = (err0[k] > 0) ? err0[k] : 0.02 * fabs(x0[k]) + 1.e-6;
+        }
+        fMin = Eval(0, fX0[0], fX0[1]);
+    }
+
+    // Минимум профиля min_T min_beta chi2 от минимума фита внутри окон; перед Bound.
+    // Возвращает chi2 в минимуме, X0 - его положение
+    double Minimize()
+    {
+        double beta = fX0[1];
+        auto profileT = [&](double T) { return Profile(0, T, beta); };
+        double T = fX0[0];
+        Minimize1D(profileT, T, fErr0[0], fLo[0], fHi[0]);
+        // beta - минимум последнего вычисленного профиля, в найденном T считается заново
+        beta = fX0[1];
+        double chi2 = Profile(0, T, beta);
+        if (chi2 < fMin)
+        {
+            fMin = chi2;
+            fX0[0] = T;
+            fX0[1] = beta;
+        }
+        return fMin;
+    }
+
+    // Граница параметра par (0 - T, 1 - beta): side < 0 - нижняя, > 0 - верхняя; ошибка со знаком от X0 (как у MINOS).
+    // atLimit - chi2 не поднимается до уровня внутри окна параметра, возвращается расстояние до края окна
+    double Bound( int par, int side, double up, bool *atLimit = 0 ) const
+    {
+        int other = 1 - par;
+        double dir = (side < 0) ? -1. : 1.;
+        double x0 = fX0[par];
+        double edge = (dir < 0) ? fLo[par] : fHi[par];
+        double step = fErr0[par];
+        if (atLimit) *atLimit = false;
+
+        // шаги от минимума (с удвоением), пока разность не станет положительной
+        double a = x0, ga = -up, yA = fX0[other];
+        double b = x0, gb = -up, yB = yA;
+        for (int i = 0; i < maxSteps; i++)
+        {
+            b = a + dir * step;
+            if (dir * (b - edge) >= 0) b = edge;
+            yB = yA;
+            gb = Profile(par, b, yB) - fMin - up;
+            if (gb >= 0) break;
+            if (b == edge)
+            {
+                if (atLimit) *atLimit = true;
+                return edge - x0;
+            }
+            a = b;
+            ga = gb;
+            yA = yB;
+            step *= 2;
+        }
+        if (gb < 0)
+        {
+            if (atLimit) *atLimit = true;
+            return b - x0;
+        }
+
+        // регула фальси (Иллинойс) между a (ниже уровня) и b (выше)
+        double eps = tolerance * fErr0[par];
+        for (int i = 0; i < 60 && fabs(b - a) > eps; i++)
+        {
+            double c = b - gb * (b - a) / (gb - ga);
+            double yC = 0.5 * (yA + yB);
+            double gc = Profile(par, c, yC) - fMin - up;
+            if ((gc < 0) == (ga < 0))
+            {
+                a = c; ga = gc; yA = yC;
+                gb *= 0.5;
+            }
+            else
+            {
+                b = c; gb = gc; yB = yC;
+                ga *= 0.5;
+            }
+        }
+        return 0.5 * (a + b) - x0;
+    }
+
+    double X0( int par ) const { return fX0[par]; }
+    double Min() const { return fMin; }
+    int NEvaluations() const { return fNEval; }
+
+private:
+    std::function<double(double, double)> fChi2;
+    double fMin;
+    double fX0[2], fErr0[2];
+    double fLo[2], fHi[2];
+    mutable int fNEval = 0;
+
+    double Eval( int par, double x, double y ) const
+    {
+        fNEval++;
+        return (par == 0) ? fChi2(x, y) : fChi2(y, x);
+    }
+
+    // min chi2 по второму параметру при первом, равном x; y - старт, на выходе - положение минимума
+    double Profile( int par, double x, double &y ) const
+    {
+        int other = 1 - par;
+        auto chi2 = [&](double v) { return Eval(par, x, v); };
+        return Minimize1D(chi2, y, fErr0[other], fLo[other], fHi[other]);
+    }
+
+    // min fn на [lo, hi] от старта y с начальным шагом h; y на выходе - положение минимума
+    template <class F>
+    double Minimize1D( const F &fn, double &y, double h, double lo, double hi ) const
+    {
+        // интервал, содержащий минимум: расширение от y, пока значения на краях не выше, чем в центре
+        y = std::min(std::max(y, lo), hi);
+        double fy = fn(y);
+        if (hi <= lo) return fy;
+        double a = std::max(lo, y - h), b = std::min(hi, y + h);
+        double fa = fn(a), fb = fn(b);
+        for (int i = 0; i < maxSteps && (fa < fy || fb < fy); i++)
+        {
+            if (fa < fy)
+            {
+                b = y; fb = fy;
+                y = a; fy = fa;
+                if (a == lo) break;
+                a = std::max(lo, y - (b - y) * 2);
+                fa = fn(a);
+            }
+            else
+            {
+                a = y; fa = fy;
+                y = b; fy = fb;
+                if (b == hi) break;
+                b = std::min(hi, y + (y - a) * 2);
+                fb = fn(b);
+            }
+        }
+
+        // золотое сечение на [a, b] до 1e-3 ошибки: chi2 в минимуме точнее 1e-6
+        const double r = 0.5 * (3. - sqrt(5.));
+        double c = a + r * (b - a), d = b - r * (b - a);
+        double fc = fn(c), fd = fn(d);
+        while (b - a > 1.e-3 * h)
+        {
+            if (fc < fd)
+            {
+                b = d; d = c; fd = fc;
+                c = a + r * (b - a);
+                fc = fn(c);
+            }
+            else
+            {
+                a = c; c = d; fc = fd;
+                d = b - r * (b - a);
+                fd = fn(d);
+            }
+        }
+        if (fc < fy) { y = c; fy = fc; }
+        if (fd < fy) { y = d; fy = fd; }
+        return fy;
+    }
+};
+
+
+#endif /* __PROFILEINTERVAL_H_ */
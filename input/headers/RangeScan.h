@@ -0,0 +1,198 @@
+#ifndef __RANGESCAN_H_
+#define __RANGESCAN_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "TROOT.h"
+#include "Fit/Fitter.h"
+#include "HFitInterface.h"
+
+#include "def.h"
+#include "AnalysisContext.h"
+#include "BlastWaveChi2.h"
+#include "TaskScheduler.h"
+
+
+// Фит одного диапазона [xlo, xhi] скана
+struct RangeCell
+{
+    double xlo, xhi;
+    int nPoints = 0;
+    bool valid = false;
+    double chi2 = 0, chi2Ndf = 0;
+    double T = 0, TErr = 0, beta = 0, betaErr = 0;
+};
+
+
+// Стабильность T и beta по сошедшимся ячейкам скана одного спектра
+struct RangeStability
+{
+    int nValid = 0;
+    double TMean = 0, TRms = 0, TMaxDev = 0;            // MaxDev - наибольшее отклонение от фита в номинальном диапазоне
+    double betaMean = 0, betaRms = 0, betaMaxDev = 0;
+};
+
+
+// Скан диапазона фита: для каждой частицы нижняя граница mT - m пробегает nLo значений
+// [xminFrom, xminTo] * xmin[part], верхняя - nHi значений [xmaxFrom, xmaxTo] * xmax[part]
+// (xmin, xmax контекста), фитируется каждая комбинация. Точки спектра читаются один раз
+// (BlastWaveChi2 на всём графике, ячейка - BlastWaveChi2::Range), фит - Minuit2 по T, beta
+// с профилированной константой на пакетном интеграле. Сначала параллельно фитируются номинальные
+// диапазоны (старт - WarmStart контекста или handT/handBeta), затем строки скана (одна нижняя граница,
+// все верхние по очереди, каждая ячейка стартует с соседней) в nThreads потоках (TaskScheduler, 0 - по числу ядер).
+// Ячейки с NDF < minNdf пропускаются
+class RangeScan
+{
+public:
+    int nLo = 20, nHi = 20;
+    double xminFrom = 0.5, xminTo = 1.5;
+    double xmaxFrom = 0.6, xmaxTo = 1.4;
+    int minNdf = 3;
+    int nThreads = 0;
+
+    std::vector<RangeCell> cells[N_PARTS][N_CENTR];    // [iLo * nHi + iHi]
+    RangeCell nominal[N_PARTS][N_CENTR];
+    RangeStability stability[N_PARTS][N_CENTR];
+
+    void Run( AnalysisContext &ctx )
+    {
+        BlastWaveBatch batch;
+
+        std::vector<std::pair<int, int>> spectra;
+        std::vector<BlastWaveChi2> chi2;
+        for (int part: PARTS)
+        {
+            for (int j = 0; j < ctx.NCentr(); j++)
+            {
+                int centr = ctx.Centr(j);
+                cells[part][centr].clear();
+                nominal[part][centr] = RangeCell();
+                stability[part][centr] = RangeStability();
+                if (!ctx.grSpectra[part][centr]) continue;
+
+                ROOT::Fit::DataOptions opt;
+                ROOT::Fit::BinData data(opt);
+                ROOT::Fit::FillData(data, ctx.grSpectra[part][centr]);
+                chi2.push_back(BlastWaveChi2(data, batch));
+                spectra.push_back(std::make_pair(part, centr));
+            }
+        }
+        int nSpectra = spectra.size();
+
+        if (nThreads != 1) ROOT::EnableThreadSafety();
+
+        // 1. Номинальные диапазоны
+        TaskScheduler::Run(nSpectra, nThreads, [&](int k) {
+            int part = spectra[k].first, centr = spectra[k].second;
+            double par[4] = {0., ctx.handT[centr], ctx.handBeta[centr], masses[part]};
+            ctx.warmStart.SeedSpecies(ctx.systN, part, centr, par);
+
+            RangeCell &cell = nominal[part][centr];
+            cell.xlo = ctx.xmin[part];
+            cell.xhi = ctx.xmax[part];
+            FitCell(chi2[k], masses[part], par[1], par[2], cell);
+        });
+
+        // 2. Сетка
+        for (int k = 0; k < nSpectra; k++)
+            cells[spectra[k].first][spectra[k].second].resize(nLo * nHi);
+
+        TaskScheduler::Run(nSpectra * nLo, nThreads, [&](int task) {
+            int k = task / nLo, iLo = task % nLo;
+            int part = spectra[k].first, centr = spectra[k].second;
+            double T0 = nominal[part][centr].T, beta0 = nominal[part][centr].beta;
+            if (!nominal[part][centr].valid)
+            {
+                T0 = ctx.handT[centr];
+                beta0 = ctx.handBeta[centr];
+            }
+
+            for (int iHi = 0; iHi < nHi; iHi++)
+            {
+                RangeCell &cell = cells[part][centr][iLo * nHi + iHi];
+                cell.xlo = ctx.xmin[part] * Step(xminFrom, xminTo, nLo, iLo);
+                cell.xhi = ctx.xmax[part] * Step(xmaxFrom, xmaxTo, nHi, iHi);
+                if (FitCell(chi2[k], masses[part], T0, beta0, cell))
+                {
+                    T0 = cell.T;
+                    beta0 = cell.beta;
+                }
+            }
+        });
+
+        for (int k = 0; k < nSpectra; k++)
+            Stability(spectra[k].first, spectra[k].second);
+    }
+
+    static double Step( double from, double to, int n, int i )
+    {
+        return (n > 1) ? from + (to - from) * i / (n - 1) : 0.5 * (from + to);
+    }
+
+private:
+    bool FitCell( const BlastWaveChi2 &full, double mass, double T0, double beta0, RangeCell &cell ) const
+    {
+        BlastWaveChi2 chi2 = full.Range(cell.xlo, cell.xhi);
+        cell.nPoints = chi2.Size();
+        int ndf = cell.nPoints - 3;
+        if (ndf < minNdf) return false;
+
+        ProfiledChi2 profiled;
+        profiled.Add(chi2, mass);
+
+        ROOT::Fit::Fitter fitter;
+        double start[2] = {T0, beta0};
+        fitter.Config().SetParamsSettings(2, start);
+        fitter.Config().ParSettings(0).SetLimits(0.02, 0.5);
+        fitter.Config().ParSettings(1).SetLimits(0., 0.95);
+        fitter.Config().MinimizerOptions().SetPrintLevel(0);
+        fitter.Config().SetMinimizer("Minuit2", "Migrad");
+        if (!fitter.FitFCN(profiled, 0, cell.nPoints, true)) return false;
+
+        const ROOT::Fit::FitResult &result = fitter.Result();
+        if (!result.IsValid()) return false;
+
+        cell.valid = true;
+        cell.chi2 = result.MinFcnValue();
+        cell.chi2Ndf = cell.chi2 / ndf;
+        cell.T = result.GetParams()[0];
+        cell.TErr = result.GetErrors()[0];
+        cell.beta = result.GetParams()[1];
+        cell.betaErr = result.GetErrors()[1];
+        return true;
+    }
+
+    void Stability( int part, int centr )
+    {
+        RangeStability &s = stability[part][centr];
+        const RangeCell &ref = nominal[part][centr];
+        for (const RangeCell &cell: cells[part][centr])
+        {
+            if (!cell.valid) continue;
+            s.nValid++;
+            s.TMean += cell.T;
+            s.betaMean += cell.beta;
+            if (ref.valid)
+            {
+                s.TMaxDev = std::max(s.TMaxDev, fabs(cell.T - ref.T));
+                s.betaMaxDev = std::max(s.betaMaxDev, fabs(cell.beta - ref.beta));
+            }
+        }
+        if (s.nValid == 0) return;
+
+        s.TMean /= s.nValid;
+        s.betaMean /= s.nValid;
+        for (const RangeCell &cell: cells[part][centr])
+        {
+            if (!cell.valid) continue;
+            s.TRms += pow(cell.T - s.TMean, 2);
+            s.betaRms += pow(cell.beta - s.betaMean, 2);
+        }
+        s.TRms = sqrt(s.TRms / s.nValid);
+        s.betaRms = sqrt(s.betaRms / s.nValid);
+    }
+};
+
+
+#endif /* __RANGESCAN_H_ */
@@ -0,0 +1,201 @@
+#ifndef __SYSTEMATICS_H_
+#define __SYSTEMATICS_H_
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+#include "TROOT.h"
+#include "TF1.h"
+#include "TGraphErrors.h"
+#include "Math/MinimizerOptions.h"
+
+#include "def.h"
+#include "AnalysisContext.h"
+#include "BlastWaveTable.h"
+#include "FitCache.h"
+#include "TaskScheduler.h"
+
+
+// Вариант систематики - перефит относительно опорного фита (BlastWaveFit, case 0).
+// Поля по умолчанию повторяют опорный фит, меняются только заданные
+struct Variation
+{
+    std::string name;
+    int group = -1;                                         // варианты одной группы (вверх/вниз) дают одно отклонение - наибольшее; -1 - своя группа
+    double constScale = 1., TScale = 1., betaScale = 1.;    // старт = опорные параметры * scale
+    double lLimitMult = 0.5, rLimitMult = 1.5;              // границы = старт * mult, как lLimitMult/rLimitMult в case 4 BlastWaveFit
+    double xminScale = 1., xmaxScale = 1.;                  // диапазон фита [xmin * xminScale, xmax * xmaxScale]
+    double yScale = 1., eyScale = 1.;                       // вариант данных: точки спектра и их ошибки * scale
+    double tilt = 0.;                                       // вариант данных: наклон y *= 1 + tilt * (-1 слева .. +1 справа диапазона)
+};
+
+
+// Варианты archive/BlastWaveSystematic.C (setParamsForSys, по одному изменению на вариант)
+// и сдвиг диапазона фита на 10%
+std::vector<Variation> DefaultVariations()
+{
+    std::vector<Variation> v(10);
+    v[0].name = "T x0.8";        v[0].group = 0; v[0].TScale = 0.8;
+    v[1].name = "T x1.2";        v[1].group = 0; v[1].TScale = 1.2;
+    v[2].name = "beta x0.8";     v[2].group = 1; v[2].betaScale = 0.8;
+    v[3].name = "beta x1.2";     v[3].group = 1; v[3].betaScale = 1.2;
+    v[4].name = "const x0.1";    v[4].group = 2; v[4].constScale = 0.1;
+    v[5].name = "const x10";     v[5].group = 2; v[5].constScale = 10.;
+    v[6].name = "limits x0.8";   v[6].group = 3; v[6].lLimitMult = 0.4; v[6].rLimitMult = 1.2;
+    v[7].name = "limits x1.2";   v[7].group = 3; v[7].lLimitMult = 0.6; v[7].rLimitMult = 1.8;
+    v[8].name = "range x0.9";    v[8].group = 4; v[8].xminScale = 0.9; v[8].xmaxScale = 0.9;
+    v[9].name = "range x1.1";    v[9].group = 4; v[9].xminScale = 1.1; v[9].xmaxScale = 1.1;
+    return v;
+}
+
+
+// Систематика параметров фита по списку вариантов. Все фиты вариант x частица x центральность
+// независимы и идут одновременно через TaskScheduler (nThreads, 0 - по числу ядер) на уже прочитанных
+// спектрах контекста; с useTables интеграл берётся из общих таблиц GetBlastWaveTable,
+// с useCache повторный проход с теми же данными и вариантами читает результаты из FitCache.
+// Отклонение варианта - |par - par_ref|; внутри группы берётся наибольшее, группы складываются квадратично.
+// Результат - parSyst[part][centr][0..2] для WriteParamsSyst (абсолютные ошибки)
+class Systematics
+{
+public:
+    std::vector<Variation> variations = DefaultVariations();
+    bool useTables = false;
+    int nThreads = 0;
+    bool useCache = false;  // результаты вариантов из FitCache, если такой фит уже был
+    FitCache cache;
+    std::string minimizerType = "Minuit2", minimizerAlgo = "";  // минимизатор вариантов (FitMinimizerOptions: TMinuit -> Minuit2)
+
+    struct Result
+    {
+        double par[N_PARTS][N_CENTR][4];
+        bool valid[N_PARTS][N_CENTR];
+    };
+    std::vector<Result> results;    // по вариантам
+
+    void Run( AnalysisContext &ctx, double ref[N_PARTS][N_CENTR][4], double parSyst[N_PARTS][N_CENTR][4] )
+    {
+        struct Task { int v, part, centr; TGraphErrors *gr; TF1 *f; double xlo, xhi; };
+        std::vector<Task> tasks;
+        BlastWaveModel model;
+        if (nThreads != 1) ROOT::EnableThreadSafety();  // до создания TF1
+
+        // Подготовка (последовательно): копии спектров и TF1 с начальными параметрами и границами
+        for (int v = 0; v < (int)variations.size(); v++)
+        {
+            const Variation &var = variations[v];
+            for (int part: PARTS)
+            {
+                for (int j = 0; j < ctx.NCentr(); j++)
+                {
+                    int centr = ctx.Centr(j);
+                    if (!ctx.grSpectra[part][centr] || ref[part][centr][0] <= 0) continue;
+
+                    Task t = {v, part, centr, 0, 0, ctx.xmin[part] * var.xminScale, ctx.xmax[part] * var.xmaxScale};
+                    t.gr = Variant(ctx.grSpectra[part][centr], var, t.xlo, t.xhi);
+
+                    string name = "syst_" + to_string(v) + "_" + to_string(part) + "_" + to_string(centr);
+                    if (useTables)
+                        t.f = new TF1(name.c_str(), BlastWaveTableFunc(GetBlastWaveTable(part)), t.xlo, t.xhi, 4);
+                    else
+                        t.f = new TF1(name.c_str(), model, t.xlo, t.xhi, 4);
+
+                    double start[4] = {ref[part][centr][0] * var.constScale, ref[part][centr][1] * var.TScale,
+                                       min(ref[part][centr][2] * var.betaScale, 0.95), masses[part]};
+                    t.f->SetParameters(start);
+                    for (int par = 0; par < 3; par++)
+                    {
+                        double hi = start[par] * var.rLimitMult;
+                        if (par == 2) hi = min(hi, 0.95);
+                        t.f->SetParLimits(par, start[par] * var.lLimitMult, hi);
+                    }
+                    t.f->FixParameter(3, masses[part]);
+                    tasks.push_back(t);
+                }
+            }
+        }
+
+        // Минимизатор - в каждом фите варианта (FitGraph), как в BlastWaveFit: глобальный по умолчанию
+        // не меняется, пока фитируют другие контексты; TMinuit не потокобезопасен - Minuit2 при любом nThreads
+        const ROOT::Math::MinimizerOptions minOptions = FitMinimizerOptions(minimizerType, minimizerAlgo);
+
+        results.assign(variations.size(), Result());
+        for (Result &r: results)
+            std::fill(&r.valid[0][0], &r.valid[0][0] + N_PARTS * N_CENTR, false);
+
+        TaskScheduler::Run(tasks.size(), nThreads, [&](int i) {
+            Task &t = tasks[i];
+            bool valid;
+            if (useCache)
+            {
+                string modelId = useTables ? "BlastWaveTable " + particles[t.part] : "BlastWaveModel " + to_string((int)gQuadrature);
+                valid = cache.Fit(t.gr, t.f, "QRNS", t.xlo, t.xhi, modelId, minOptions);
+            }
+            else
+            {
+                TFitResultPtr fitResult = FitGraph(t.gr, t.f, "QRNS", t.xlo, t.xhi, minOptions);
+                valid = fitResult->IsValid();
+            }
+            Result &r = results[t.v];
+            std::copy(t.f->GetParameters(), t.f->GetParameters() + 4, r.par[t.part][t.centr]);
+            r.valid[t.part][t.centr] = valid;
+        });
+
+        int nFailed = 0;
+        for (Task &t: tasks)
+        {
+            nFailed += !results[t.v].valid[t.part][t.centr];
+            delete t.f;
+            delete t.gr;
+        }
+        cout << "Systematics: " << tasks.size() << " fits, " << nFailed << " not converged (skipped)" << endl;
+
+        Combine(ctx, ref, parSyst);
+    }
+
+private:
+    // Копия спектра с вариантом данных
+    static TGraphErrors *Variant( const TGraphErrors *gr, const Variation &var, double xlo, double xhi )
+    {
+        TGraphErrors *copy = new TGraphErrors(*gr);
+        for (int i = 0; i < copy->GetN(); i++)
+        {
+            double scale = var.yScale;
+            if (var.tilt != 0) scale *= 1. + var.tilt * (2. * (copy->GetX()[i] - xlo) / (xhi - xlo) - 1.);
+            copy->GetY()[i] *= scale;
+            copy->GetEY()[i] *= scale * var.eyScale;
+        }
+        return copy;
+    }
+
+    // Отклонения вариантов: наибольшее в группе, группы - квадратично
+    void Combine( AnalysisContext &ctx, double ref[N_PARTS][N_CENTR][4], double parSyst[N_PARTS][N_CENTR][4] ) const
+    {
+        for (int part: PARTS)
+        {
+            for (int j = 0; j < ctx.NCentr(); j++)
+            {
+                int centr = ctx.Centr(j);
+                for (int p = 0; p < 4; p++) parSyst[part][centr][p] = 0;
+
+                for (int p = 0; p < 3; p++)
+                {
+                    std::map<int, double> groupDev;
+                    for (int v = 0; v < (int)variations.size(); v++)
+                    {
+                        if (!results[v].valid[part][centr]) continue;
+                        int group = (variations[v].group >= 0) ? variations[v].group : -1 - v;
+                        double dev = fabs(results[v].par[part][centr][p] - ref[part][centr][p]);
+                        groupDev[group] = max(groupDev[group], dev);
+                    }
+                    for (auto &g: groupDev) parSyst[part][centr][p] += g.second * g.second;
+                    parSyst[part][centr][p] = sqrt(parSyst[part][centr][p]);
+                }
+            }
+        }
+    }
+};
+
+
+#endif /* __SYSTEMATICS_H_ */
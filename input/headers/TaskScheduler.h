@@ -0,0 +1,85 @@
+#ifndef __TASKSCHEDULER_H_
+#define __TASKSCHEDULER_H_
+
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Планировщик независимых задач с перехватом работы (work stealing).
+// Задачи 0..nTasks-1 раскладываются по очередям потоков по кругу. Поток берёт задачи
+// с конца своей очереди, а когда она пуста - забирает с начала очереди другого потока,
+// поэтому долгие задачи (периферийные центральности) не держат остальные потоки без работы.
+// Задача сама пишет результат по своему индексу, так что он не зависит от порядка выполнения.
+class TaskScheduler
+{
+public:
+    // nThreads <= 1 - все задачи по порядку в вызывающем потоке; 0 - по числу ядер
+    static void Run( int nTasks, int nThreads, const std::function<void(int)> &task )
+    {
+        if (nThreads == 0) nThreads = std::thread::hardware_concurrency();
+        if (nThreads > nTasks) nThreads = nTasks;
+        if (nThreads <= 1)
+        {
+            for (int i = 0; i < nTasks; i++) task(i);
+            return;
+        }
+
+        std::vector<Queue> queues(nThreads);
+        for (int i = 0; i < nTasks; i++)
+            queues[i % nThreads].tasks.push_back(i);
+
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        std::vector<std::thread> threads;
+        for (int w = 0; w < nThreads; w++)
+        {
+            threads.emplace_back([&, w]() {
+                int i;
+                while (Next(queues, w, i))
+                {
+                    try { task(i); }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(errorMutex);
+                        if (!error) error = std::current_exception();
+                    }
+                }
+            });
+        }
+        for (auto &t: threads) t.join();
+
+        if (error) std::rethrow_exception(error);
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    // Следующая задача для потока w: своя (с конца) или чужая (с начала); false - задач не осталось
+    static bool Next( std::vector<Queue> &queues, int w, int &i )
+    {
+        int n = queues.size();
+        for (int k = 0; k < n; k++)
+        {
+            Queue &q = queues[(w + k) % n];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.tasks.empty()) continue;
+
+            if (k == 0) { i = q.tasks.back();  q.tasks.pop_back(); }
+            else        { i = q.tasks.front(); q.tasks.pop_front(); }
+            return true;
+        }
+        return false;
+    }
+};
+
+
+#endif /* __TASKSCHEDULER_H_ */
@@ -0,0 +1,179 @@
+#ifndef __TOYS_H_
+#define __TOYS_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "TROOT.h"
+#include "TRandom3.h"
+#include "Fit/Fitter.h"
+#include "HFitInterface.h"
+
+#include "def.h"
+#include "AnalysisContext.h"
+#include "BlastWaveChi2.h"
+#include "TaskScheduler.h"
+
+
+// Распределение параметров фита одного спектра по псевдоэкспериментам
+struct ToySummary
+{
+    int nToys = 0, nValid = 0;
+    double mean[3] = {}, median[3] = {}, lo[3] = {}, hi[3] = {};   // {constant, T, beta}; [lo, hi] - центральный интервал cl
+    double cov[3][3] = {};
+};
+
+
+// Ошибки параметров по псевдоэкспериментам вместо ошибок Minuit, умноженных на sqrt(chi2/NDF).
+// Каждая точка grSpectra в диапазоне фита разыгрывается по Гауссу в пределах статистической ошибки (ey графика)
+// и систематической s_s (spectraSys): y' = y + ey g_i + s_s (sqrt(sysCorrelation) g_0 + sqrt(1 - sysCorrelation) g_i'),
+// sysCorrelation - доля систематики, общая для всех точек спектра. Каждая реплика фитируется заново
+// (Minuit2 по T, beta с профилированной константой на пакетном интеграле BlastWaveBatch) со старта из номинального фита.
+// Реплики идут блоками по blockSize в nThreads потоках (TaskScheduler, 0 - по числу ядер); в блоке chi2, фиттер и
+// генератор создаются один раз, у реплики меняются только значения точек (BlastWaveChi2::SetY), без TF1 и TGraphErrors.
+// Генератор блока зависит только от seed, спектра и номера блока, поэтому результат не зависит от числа потоков
+class Toys
+{
+public:
+    int nToys = 1000;
+    int nThreads = 0;
+    int blockSize = 100;
+    unsigned int seed = 4357;
+    double sysCorrelation = 0.;
+    double cl = 0.6827;
+
+    ToySummary summary[N_PARTS][N_CENTR];
+
+    // nominal - номинальные параметры {constant, T, beta, mass} (outParams BlastWaveFit)
+    void Run( AnalysisContext &ctx, double nominal[N_PARTS][N_CENTR][4] )
+    {
+        BlastWaveBatch batch;
+
+        // Номинальные chi2 спектров и индексы их точек в графике (для s_s)
+        std::vector<std::pair<int, int>> spectra;
+        std::vector<BlastWaveChi2> chi2;
+        std::vector<std::vector<double>> sys;
+        for (int part: PARTS)
+        {
+            for (int j = 0; j < ctx.NCentr(); j++)
+            {
+                int centr = ctx.Centr(j);
+                summary[part][centr] = ToySummary();
+                TGraphErrors *gr = ctx.grSpectra[part][centr];
+                if (!gr || nominal[part][centr][0] <= 0) continue;
+
+                ROOT::Fit::DataOptions opt;
+                ROOT::Fit::DataRange range(ctx.xmin[part], ctx.xmax[part]);
+                ROOT::Fit::BinData data(opt, range);
+                ROOT::Fit::FillData(data, gr);
+                chi2.push_back(BlastWaveChi2(data, batch));
+
+                std::vector<double> s;
+                for (double x: chi2.back().X())
+                {
+                    int i = 0;
+                    while (i < gr->GetN() && i < MAX_POINTS && gr->GetX()[i] != x) i++;
+                    s.push_back((i < gr->GetN() && i < MAX_POINTS) ? ctx.spectraSys[part][centr][i] : 0.);
+                }
+                sys.push_back(s);
+                spectra.push_back(std::make_pair(part, centr));
+            }
+        }
+
+        int nBlocks = (nToys + blockSize - 1) / blockSize;
+        int nSpectra = spectra.size();
+        std::vector<std::vector<double>> values(nSpectra, std::vector<double>(3 * nToys));
+        std::vector<std::vector<char>> valid(nSpectra, std::vector<char>(nToys, 0));
+
+        if (nThreads != 1) ROOT::EnableThreadSafety();
+
+        TaskScheduler::Run(nSpectra * nBlocks, nThreads, [&](int task) {
+            int k = task / nBlocks, block = task % nBlocks;
+            int part = spectra[k].first, centr = spectra[k].second;
+
+            BlastWaveChi2 toyChi2 = chi2[k];
+            ProfiledChi2 profiled;
+            profiled.Add(toyChi2, masses[part]);
+
+            ROOT::Fit::Fitter fitter;
+            fitter.Config().MinimizerOptions().SetPrintLevel(0);
+            fitter.Config().SetMinimizer("Minuit2", "Migrad");
+            double start[2] = {nominal[part][centr][1], nominal[part][centr][2]};
+            fitter.Config().SetParamsSettings(2, start);
+            fitter.Config().ParSettings(0).SetLimits(0.02, 0.5);
+            fitter.Config().ParSettings(1).SetLimits(0., 0.95);
+            ROOT::Fit::FitConfig config = fitter.Config();
+
+            TRandom3 rnd(seed + 7919u * k + 104729u * block);
+            const std::vector<double> &y = chi2[k].Y(), &ey = chi2[k].EY();
+            int n = y.size();
+            std::vector<double> yToy(n);
+            double sc = sqrt(sysCorrelation), su = sqrt(1. - sysCorrelation);
+
+            for (int t = block * blockSize; t < std::min(nToys, (block + 1) * blockSize); t++)
+            {
+                double g0 = rnd.Gaus();
+                for (int i = 0; i < n; i++)
+                    yToy[i] = y[i] + ey[i] * rnd.Gaus() + sys[k][i] * (sc * g0 + su * rnd.Gaus());
+                toyChi2.SetY(yToy.data());
+
+                fitter.Config() = config;
+                if (!fitter.FitFCN(profiled, 0, n, true) || !fitter.Result().IsValid()) continue;
+
+                const double *x = fitter.Result().GetParams();
+                double con;
+                profiled.Constants(x, &con);
+                values[k][3 * t] = con;
+                values[k][3 * t + 1] = x[0];
+                values[k][3 * t + 2] = x[1];
+                valid[k][t] = 1;
+            }
+        });
+
+        for (int k = 0; k < nSpectra; k++)
+            Summarize(values[k], valid[k], summary[spectra[k].first][spectra[k].second]);
+    }
+
+private:
+    // Среднее, ковариация и центральный интервал cl по сошедшимся репликам
+    void Summarize( const std::vector<double> &values, const std::vector<char> &valid, ToySummary &s ) const
+    {
+        s.nToys = valid.size();
+        std::vector<double> v[3];
+        for (int t = 0; t < s.nToys; t++)
+            if (valid[t])
+                for (int p = 0; p < 3; p++) v[p].push_back(values[3 * t + p]);
+        s.nValid = v[0].size();
+        if (s.nValid < 2) return;
+
+        for (int p = 0; p < 3; p++)
+        {
+            for (double x: v[p]) s.mean[p] += x / s.nValid;
+
+            std::vector<double> sorted = v[p];
+            std::sort(sorted.begin(), sorted.end());
+            s.median[p] = Quantile(sorted, 0.5);
+            s.lo[p] = Quantile(sorted, 0.5 * (1. - cl));
+            s.hi[p] = Quantile(sorted, 0.5 * (1. + cl));
+        }
+        for (int p = 0; p < 3; p++)
+            for (int q = 0; q < 3; q++)
+            {
+                for (int t = 0; t < s.nValid; t++)
+                    s.cov[p][q] += (v[p][t] - s.mean[p]) * (v[q][t] - s.mean[q]);
+                s.cov[p][q] /= s.nValid - 1;
+            }
+    }
+
+    // Квантиль отсортированной выборки с линейной интерполяцией
+    static double Quantile( const std::vector<double> &sorted, double q )
+    {
+        double pos = q * (sorted.size() - 1);
+        int i = (int)pos;
+        if (i + 1 >= (int)sorted.size()) return sorted.back();
+        return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+    }
+};
+
+
+#endif /* __TOYS_H_ */
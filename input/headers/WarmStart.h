@@ -0,0 +1,115 @@
+#ifndef __WARMSTART_H_
+#define __WARMSTART_H_
+
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "def.h"
+
+
+// Тёплый старт фитов: сошедшиеся параметры хранятся в памяти и служат стартом
+// для соседней центральности (ближайшей по Npart) и для последующего фита по частицам,
+// вместо статических таблиц handT/handBeta/handConst и повторного чтения файлов параметров.
+// Глобальные фиты хранятся в раскладке paramsGlobal: {T, beta, константы...};
+// 8 параметров - BlastWaveGlobal_all (константа частицы part - [2 + part]),
+// 5 - BlastWaveGlobal (константа частицы part - [2 + part / 2], заряд - part % 2).
+// Фиты по частицам - в раскладке ifuncx: {constant, T, beta, mass}.
+// Доступ защищён мьютексом: фиты BlastWaveFit идут параллельно.
+class WarmStart
+{
+public:
+    void StoreGlobal( int systN, int charge, int centr, const double *par, int n )
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fGlobal[std::make_tuple(systN, charge, centr)].assign(par, par + n);
+    }
+
+    void StoreSpecies( int systN, int part, int centr, const double par[4] )
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fSpecies[std::make_tuple(systN, part, centr)].assign(par, par + 4);
+    }
+
+    // Старт глобального фита centr из ближайшей по Npart сошедшейся центральности с той же раскладкой;
+    // false - соседа нет, par не меняется (остаются статические таблицы)
+    bool SeedGlobal( int systN, int charge, int centr, double *par, int n ) const
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        const std::vector<double> *best = Nearest(fGlobal, systN, charge, centr, n, true);
+        if (!best) return false;
+        std::copy(best->begin(), best->end(), par);
+        return true;
+    }
+
+    // Старт фита частицы part: её же результат, иначе глобальный фит этой центральности,
+    // иначе результат частицы в ближайшей центральности; false - ничего нет
+    bool SeedSpecies( int systN, int part, int centr, double par[4] ) const
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        auto it = fSpecies.find(std::make_tuple(systN, part, centr));
+        if (it != fSpecies.end())
+        {
+            std::copy(it->second.begin(), it->second.end(), par);
+            return true;
+        }
+
+        int charge = part % 2;
+        auto g = fGlobal.find(std::make_tuple(systN, charge, centr));
+        if (g != fGlobal.end() && (g->second.size() == 8 || g->second.size() == 5))
+        {
+            const std::vector<double> &p = g->second;
+            par[0] = (p.size() == 8) ? p[2 + part] : p[2 + part / 2];
+            par[1] = p[0];
+            par[2] = p[1];
+            par[3] = masses[part];
+            return true;
+        }
+
+        const std::vector<double> *best = Nearest(fSpecies, systN, part, centr, 4, false);
+        if (!best) return false;
+        std::copy(best->begin(), best->end(), par);
+        return true;
+    }
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fGlobal.clear();
+        fSpecies.clear();
+    }
+
+private:
+    typedef std::map<std::tuple<int, int, int>, std::vector<double>> Store;
+
+    mutable std::mutex fMutex;
+    Store fGlobal, fSpecies;
+
+    // Запись (systN, index, c) c ближайшим к centr Npart и размером n; self - можно ли взять саму centr
+    static const std::vector<double> *Nearest( const Store &store, int systN, int index, int centr, int n, bool self )
+    {
+        const std::vector<double> *best = 0;
+        double dmin = 0;
+        for (int j = 0; j < N_CENTR_SYST[systN]; j++)
+        {
+            int c = CENTR_SYST[systN][j];
+            if (c == centr && !self) continue;
+
+            auto it = store.find(std::make_tuple(systN, index, c));
+            if (it == store.end() || (int)it->second.size() != n) continue;
+
+            double d = fabs(Npart[systN][c] - Npart[systN][centr]);
+            if (!best || d < dmin)
+            {
+                best = &it->second;
+                dmin = d;
+            }
+        }
+        return best;
+    }
+};
+
+
+#endif /* __WARMSTART_H_ */
@@ -1,6 +1,8 @@
 #ifndef __WRITEREADFILES_H_
 #define __WRITEREADFILES_H_
 
+#include <limits>
+#include <sstream>
 #include "def.h"
 
 
@@ -8,7 +10,10 @@
 
 
 // Определение функции для чтения спектральных данных из файла для конкретной части и системы
-void ReadFromFile( int part, int systN )
+// spectra - куда сохранять графики (по умолчанию глобальный grSpectra, иначе массив AnalysisContext),
+// sys - систематические ошибки s_s точек графиков
+void ReadFromFile( int part, int systN, TGraphErrors *spectra[][N_CENTR] = grSpectra,
+                   double sys[][N_CENTR][MAX_POINTS] = spectraSys )
 {
     int N; 
     // mT – поперечная масса, pT – поперечный импульс, s – спектральные данные, 
@@ -29,15 +34,16 @@ void ReadFromFile( int part, int systN )
         {
             f >> pT[i] >> s[i] >> s_e[i] >> s_s[i];
             mT[i]  = sqrt(pT[i] * pT[i] + masses[part] * masses[part]) - masses[part];
+            sys[part][centr][i] = s_s[i];
         }
-        // Создаём график с ошибками (TGraphErrors) для текущей части и центральности и сохраняем его в глобальный массив grSpectra 
-        grSpectra[part][centr] = new TGraphErrors(N, mT, s, s_e, x_e);
+        // Создаём график с ошибками (TGraphErrors) для текущей части и центральности и сохраняем его в массив spectra
+        spectra[part][centr] = new TGraphErrors(N, mT, s, s_e, x_e);
     }
 }
 
 
 // Функция для чтения спектральных данных для системы AuAu
-void ReadFromFileAuAu( void )
+void ReadFromFileAuAu( TGraphErrors *spectra[][N_CENTR] = grSpectra )
 {
     int N;
     // mT и pT – поперечные масса и импульс, s и s_e – двумерные массивы (по центральностям и точкам), x_e – ошибки по оси X
@@ -65,23 +71,23 @@ void ReadFromFileAuAu( void )
             }
         }
 
-        // Создаём графики с ошибками для каждой центральности и сохраняем в глобальный массив grSpectra
+        // Создаём графики с ошибками для каждой центральности и сохраняем в массив spectra
         for (int centr = 0; centr < Ncentr[0]; centr++)
         {
-            grSpectra[part][centr] = new TGraphErrors(N, mT, s[centr], x_e, s_e[centr]);
+            spectra[part][centr] = new TGraphErrors(N, mT, s[centr], x_e, s_e[centr]);
         }
     }
 }
 
 
 // Извлечение глобальных параметры модели 
-void getGlobalParams( int part, int centr, double parResults[4] )
+void getGlobalParams( int part, int centr, double parResults[4], double params[][N_CENTR][8] = paramsGlobal )
 {
     int charge = part % 2; 
 
-    parResults[0] = paramsGlobal[charge][centr][2 + part / 2];
-    parResults[1] = paramsGlobal[charge][centr][0]; 
-    parResults[2] = paramsGlobal[charge][centr][1]; 
+    parResults[0] = params[charge][centr][2 + part / 2];
+    parResults[1] = params[charge][centr][0]; 
+    parResults[2] = params[charge][centr][1]; 
     parResults[3] = masses[part];     
 }
 
@@ -117,9 +123,12 @@ void WriteGlobalParams( bool *isParamsFileExist, int charge, int systN, const ch
 
 
 // Запись параметров от финального перефита с использованием кейса из input/BlastWaveFit.h
-// Запись параметров производится в файл с определённым названием, если не задано другого 
+// Запись параметров производится в файл с определённым названием, если не задано другого.
+// parInterval (BlastWaveFit::outParamsInterval) - в конце строки ещё T-, T+, beta-, beta+ и, если есть
+// intervalLimit (BlastWaveFit::outIntervalLimit), маска границ на краю окна фита (бит 0 - T-, ..., 3 - beta+)
 void WriteParams( int systN, double par[N_PARTS][N_CENTR][4], double parErr[N_PARTS][N_CENTR][4],
-                  int printAll = true, const char filename[30] = "output/txtParams/BWparams_pAl.txt")
+                  int printAll = true, const char filename[30] = "output/txtParams/BWparams_pAl.txt",
+                  double (*parInterval)[N_CENTR][4] = 0, int (*intervalLimit)[N_CENTR] = 0 )
 {
     ofstream txtFile;
 
@@ -136,7 +145,12 @@ void WriteParams( int systN, double par[N_PARTS][N_CENTR][4], double parErr[N_PA
                         << par[part][centr][1] << "  " 
                         << parErr[part][centr][1] << "  "
                         << par[part][centr][2] << "  " 
-                        << parErr[part][centr][2] << endl;
+                        << parErr[part][centr][2];
+                if (parInterval)
+                    for (int k = 0; k < 4; k++) txtFile << "  " << parInterval[part][centr][k];
+                if (parInterval && intervalLimit)
+                    txtFile << "  " << intervalLimit[part][centr];
+                txtFile << endl;
             }
         }
     }
@@ -182,6 +196,57 @@ void WriteParamsSyst( int systN, double par[N_PARTS][N_CENTR][4], double parErr[
 }
 
 
+// Запись контуров BlastWaveFit (isContour): по строке на точку - part, centr, nsigma, beta, T
+void WriteContours( int systN, TGraph *cont[][N_CENTR][N_SIGMA] = contour,
+                    const char filename[30] = "output/parameters/ALL_BWcontours_AuAu.txt" )
+{
+    ofstream txtFile;
+    txtFile.open(filename);
+
+    for (int part : PARTS)
+    {
+        for (int j = 0; j < N_CENTR_SYST[systN]; j++) {
+            int centr = CENTR_SYST[systN][j];
+            for (int nsigma = 1; nsigma < N_SIGMA; nsigma++) {
+                TGraph *gr = cont[part][centr][nsigma];
+                if (!gr) continue;
+                for (int i = 0; i < gr->GetN(); i++)
+                    txtFile << part << "  " << centr << "  " << nsigma << "  "
+                            << gr->GetX()[i] << "  " << gr->GetY()[i] << endl;
+            }
+        }
+    }
+
+    txtFile.close();
+}
+
+
+// Чтение контуров, записанных WriteContours, в cont (x - beta, y - T)
+void ReadContours( TGraph *cont[][N_CENTR][N_SIGMA] = contour,
+                   const char filename[30] = "output/parameters/ALL_BWcontours_AuAu.txt" )
+{
+    ifstream f;
+    f.open(filename);
+
+    // прежние точки (повторное чтение) удаляются, графики остаются
+    for (int part = 0; part < MAX_PARTS; part++)
+        for (int centr = 0; centr < N_CENTR; centr++)
+            for (int nsigma = 0; nsigma < N_SIGMA; nsigma++)
+                if (cont[part][centr][nsigma]) cont[part][centr][nsigma]->Set(0);
+
+    int part, centr, nsigma;
+    double beta, T;
+    while (f >> part >> centr >> nsigma >> beta >> T)
+    {
+        if (part < 0 || part >= MAX_PARTS || centr < 0 || centr >= N_CENTR || nsigma < 0 || nsigma >= N_SIGMA) continue;
+        if (!cont[part][centr][nsigma]) cont[part][centr][nsigma] = new TGraph();
+        TGraph *gr = cont[part][centr][nsigma];
+        gr->SetPoint(gr->GetN(), beta, T);
+    }
+    f.close();
+}
+
+
 /* ================================ BWDrawParams.C ================================ */
 
 
@@ -205,6 +270,7 @@ void ReadParam( int parN, double par[N_PARTS][N_CENTR], double parErr[N_PARTS][N
               >> tmpParErr[1] 
               >> tmpPar[2] 
               >> tmpParErr[2];
+            f.ignore(numeric_limits<streamsize>::max(), '\n');  // интервалы WriteParams, если есть
 
             par[part][centr] = tmpPar[parN];
             parErr[part][centr] = tmpParErr[parN];
@@ -234,6 +300,7 @@ void ReadParam( int parN, double par[N_PARTS][N_CENTR], double parErr[N_PARTS][N
               >> tmpPar[2] 
               >> tmpParErr[2]; 
             //   >> tmpParSyst[2];
+            f.ignore(numeric_limits<streamsize>::max(), '\n');
               
             par[part][centr] = tmpPar[parN];
             parErr[part][centr] = tmpParErr[parN];
@@ -248,27 +315,27 @@ void ReadParam( int parN, double par[N_PARTS][N_CENTR], double parErr[N_PARTS][N
 
 
 // Чтение параметров из глобального фита (можно брать другие данные, но с тем же форматом)
-void ReadGlobalParams( int systN, double paramsGlobal[2][N_CENTR][5], const char filename[30] = "output/parameters/GlobalBWparams_AuAu.txt" )
+void ReadGlobalParams( int systN, double paramsGlobal[2][N_CENTR][8], const char filename[30] = "output/parameters/GlobalBWparams_AuAu.txt" )
 {
     ifstream txtFile;
     txtFile.open(filename);
 
-    int charge;
-    while (true)
+    // По строке на запись: charge, centr и 5 параметров; остальные столбцы (интервалы WriteParams)
+    // и пустые строки между зарядами пропускаются, неполная строка не читается
+    int charge, centr;
+    double values[5];
+    string line;
+    while (getline(txtFile, line))
     {
-        for (int j = 0; j < N_CENTR_SYST[systN]; j++) {
-            int centr = CENTR_SYST[systN][j];
-            txtFile >> charge >> centr 
-                    >> paramsGlobal[charge][centr][0] // T for AuAu
-                    >> paramsGlobal[charge][centr][1] // beta for AuAu // T for else
-                    >> paramsGlobal[charge][centr][2] 
-                    >> paramsGlobal[charge][centr][3] // beta for else
-                    >> paramsGlobal[charge][centr][4];
-
-            // cout << paramsGlobal[charge][centr][0] << endl;
-        }
-        
-        if( txtFile.eof() ) break;
+        istringstream ss(line);
+        if (!(ss >> charge >> centr >> values[0] >> values[1] >> values[2] >> values[3] >> values[4])) continue;
+        if (charge < 0 || charge > 1 || centr < 0 || centr >= N_CENTR) continue;
+
+        paramsGlobal[charge][centr][0] = values[0]; // T for AuAu
+        paramsGlobal[charge][centr][1] = values[1]; // beta for AuAu // T for else
+        paramsGlobal[charge][centr][2] = values[2];
+        paramsGlobal[charge][centr][3] = values[3]; // beta for else
+        paramsGlobal[charge][centr][4] = values[4];
     }
     
     txtFile.close();
@@ -375,13 +442,14 @@ void ReadParams( double par[N_PARTS][N_CENTR][4], double parErr[N_PARTS][N_CENTR
             int centr = CENTR_SYST[systN][j];
             f >> p >> c >> par[p][c][0]
               >> par[p][c][1] >> parErr[p][c][1] >> par[p][c][2] >> parErr[p][c][2];
+            f.ignore(numeric_limits<streamsize>::max(), '\n');  // интервалы WriteParams, если есть
         }
     }
     f.close();
 }
 
 void ReadParams( int part, int centr, double par[4],
-                 const char filename[30] = "output/txtParams/BWparams.txt" )
+                 const char filename[30] = "output/txtParams/BWparams.txt", int systN = ::systN )
 {
     ifstream f;
     f.open(filename);
@@ -394,6 +462,7 @@ void ReadParams( int part, int centr, double par[4],
         for (int j = 0; j < N_CENTR_SYST[systN]; j++) {
             int centr = CENTR_SYST[systN][j];
             f >> p >> c >> par[0] >> par[1] >> dummyErr >> par[2] >> dummyErr;
+            f.ignore(numeric_limits<streamsize>::max(), '\n');
             if (j == centr) break;
         }
         par[3] = masses[part];
@@ -23,6 +23,7 @@ const int MAX_PARTS = 6;                    // Максимальное числ
 const int N_CENTR = 12;                      // Текущее число центральностей
 const int N_PARTS = 6;                      // Текущее число частиц
 const int N_SIGMA = 7;                      // Число сигм для контуров
+const int MAX_POINTS = 30;                  // Максимальное число точек в спектре
 const int PARTS[] = {0, 1, 2, 3, 4, 5};     // Индексы всех частиц
 const int PARTS_POS[] = {0, 2, 4};          // Положительные частицы (π⁺, K⁺, p)
 const int PARTS_NEG[] = {1, 3, 5};          // Отрицательные частицы (π⁻, K⁻, анти-p)
@@ -44,8 +45,9 @@ int SYSTS[] = {0, 1, 2, 3, 4};
 
 
 TGraph *contour[MAX_PARTS][N_CENTR][N_SIGMA];
+double spectraSys[MAX_PARTS][N_CENTR][MAX_POINTS]; // систематические ошибки точек grSpectra (s_s; для AuAu нет - 0)
 TF1 *ifuncx[MAX_PARTS][N_CENTR], *ifuncxGlobal[MAX_PARTS][N_CENTR];
-double paramsGlobal[2][N_CENTR][5]; // [2] - charge, 5 - количество параметров 1) T 2) ut 3) const pi 4) const K 5) const p
+double paramsGlobal[2][N_CENTR][8]; // [2] - charge, 8 - количество параметров 1) T 2) ut 3...) константы частиц (3 в BlastWaveGlobal, 6 в BlastWaveGlobal_all)
 
 
 